@@ -0,0 +1,40 @@
+// Microbenchmark of the ae time events that pace every connection:
+// registering a large number of timers and firing them all.
+
+#include "bench.h"
+#include "ae.h"
+
+#define TIMERS 100000
+
+static uint64_t fired;
+
+static int timer_fire(aeEventLoop *loop, long long id, void *data) {
+    fired++;
+    return AE_NOMORE;
+}
+
+int main(int argc, char **argv) {
+    uint64_t n = bench_iterations(argc, argv, 3);
+    aeEventLoop *loop = aeCreateEventLoop(64);
+    bench b;
+
+    printf("ae_timers: %"PRIu64" rounds of %d timers\n", n, TIMERS);
+
+    for (uint64_t round = 0; round < n; round++) {
+        b = bench_start();
+        for (int i = 0; i < TIMERS; i++) {
+            aeCreateTimeEvent(loop, 0, timer_fire, NULL, NULL);
+        }
+        bench_report(&b, "aeCreateTimeEvent", TIMERS);
+
+        fired = 0;
+        b = bench_start();
+        while (fired < TIMERS) {
+            aeProcessEvents(loop, AE_TIME_EVENTS | AE_DONT_WAIT);
+        }
+        bench_report(&b, "fire", TIMERS);
+    }
+
+    aeDeleteEventLoop(loop);
+    return 0;
+}
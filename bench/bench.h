@@ -0,0 +1,67 @@
+// Helpers shared by the microbenchmarks: a monotonic clock and, when
+// linked with -Wl,--wrap for the allocator (see the Makefile), a count
+// of malloc, calloc and realloc calls.
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static uint64_t allocs;
+
+#ifdef BENCH_ALLOCS
+void *__real_malloc(size_t);
+void *__real_calloc(size_t, size_t);
+void *__real_realloc(void *, size_t);
+
+void *__wrap_malloc(size_t size) {
+    __sync_fetch_and_add(&allocs, 1);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    __sync_fetch_and_add(&allocs, 1);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    __sync_fetch_and_add(&allocs, 1);
+    return __real_realloc(ptr, size);
+}
+#endif
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+typedef struct {
+    uint64_t start;
+    uint64_t allocs;
+} bench;
+
+static bench bench_start() {
+    bench b = { .allocs = allocs };
+    b.start = now_ns();
+    return b;
+}
+
+// Print the time and allocations per operation since bench_start.
+static void bench_report(bench *b, char *name, uint64_t n) {
+    double ns = (now_ns() - b->start) / (double) n;
+    printf("  %-32s %10.2f ns/op", name, ns);
+#ifdef BENCH_ALLOCS
+    printf(" %8.2f allocs/op", (allocs - b->allocs) / (double) n);
+#endif
+    printf("\n");
+}
+
+static uint64_t bench_iterations(int argc, char **argv, uint64_t n) {
+    return argc > 1 ? strtoull(argv[1], NULL, 10) : n;
+}
+
+#endif /* BENCH_H */
@@ -0,0 +1,70 @@
+// Microbenchmark of reading hdr histograms: the percentile lookups and
+// merges wrk performs once per thread at the end of every run, and per
+// interval with --hdr_interval.
+
+#include <stdbool.h>
+
+#include "bench.h"
+#include "hdr_histogram.h"
+
+#define MAX_LATENCY 24L * 60 * 60 * 1000000
+#define VALUES      (1 << 20)
+
+static struct hdr_histogram *histogram() {
+    struct hdr_histogram *h;
+    if (hdr_init(1, MAX_LATENCY, 3, &h)) {
+        fprintf(stderr, "unable to allocate histogram\n");
+        exit(1);
+    }
+    return h;
+}
+
+// Latencies spread over many buckets, from microseconds to tens of seconds.
+static void fill(struct hdr_histogram *h) {
+    uint64_t s = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < VALUES; i++) {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        int bits = 7 + s % 18;
+        hdr_record_value(h, 1 + ((s >> 8) & ((1ULL << bits) - 1)));
+    }
+}
+
+int main(int argc, char **argv) {
+    uint64_t n = bench_iterations(argc, argv, 1000);
+    struct hdr_histogram *h = histogram(), *total = histogram();
+    double percentiles[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+    int64_t sum = 0;
+    bench b;
+
+    fill(h);
+
+    printf("hdr_query: %"PRIu64" iterations, %d values\n", n, VALUES);
+
+    b = bench_start();
+    for (uint64_t i = 0; i < n; i++) {
+        sum += hdr_value_at_percentile(h, percentiles[i % 5]);
+    }
+    bench_report(&b, "hdr_value_at_percentile", n);
+
+    b = bench_start();
+    for (uint64_t i = 0; i < n; i++) {
+        sum += hdr_mean(h) + hdr_stddev(h);
+    }
+    bench_report(&b, "hdr_mean + hdr_stddev", n);
+
+    b = bench_start();
+    for (uint64_t i = 0; i < n; i++) {
+        hdr_add(total, h);
+    }
+    bench_report(&b, "hdr_add", n);
+
+    b = bench_start();
+    for (uint64_t i = 0; i < n; i++) {
+        hdr_reset(total);
+    }
+    bench_report(&b, "hdr_reset", n);
+
+    return sum == 0;
+}
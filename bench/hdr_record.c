@@ -0,0 +1,104 @@
+// Microbenchmark of recording latencies into hdr histograms.
+//
+// Compares the generic hdr_record_value path with the inline fast path,
+// for a single histogram and for the per-response pattern used by wrk,
+// where one value goes into several histograms sharing a layout.
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "bench.h"
+#include "hdr_histogram.h"
+
+#define MAX_LATENCY 24L * 60 * 60 * 1000000
+#define VALUES      (1 << 20)
+
+static int64_t values[VALUES];
+static int64_t u_values[VALUES];
+
+static uint64_t xorshift(uint64_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+// Latencies spread over many buckets, from microseconds to tens of seconds.
+static void generate() {
+    uint64_t s = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < VALUES; i++) {
+        uint64_t r = xorshift(&s);
+        int bits = 7 + r % 18;
+        values[i]   = 1 + ((r >> 8) & ((1ULL << bits) - 1));
+        u_values[i] = 1 + values[i] / 2;
+    }
+}
+
+static struct hdr_histogram *histogram() {
+    struct hdr_histogram *h;
+    if (hdr_init(1, MAX_LATENCY, 3, &h)) {
+        fprintf(stderr, "unable to allocate histogram\n");
+        exit(1);
+    }
+    return h;
+}
+
+int main(int argc, char **argv) {
+    uint64_t n = bench_iterations(argc, argv, 50000000);
+    struct hdr_histogram *latency = histogram(), *success = histogram(), *u_latency = histogram();
+    bench b;
+
+    generate();
+
+    // The fast path must index exactly like the generic one.
+    for (int i = 0; i < VALUES; i++) {
+        hdr_record_value(latency, values[i]);
+        hdr_record_value_fast(success, values[i]);
+    }
+    if (memcmp(latency->counts, success->counts, latency->counts_len * sizeof(int64_t))) {
+        fprintf(stderr, "hdr_record_value_fast does not match hdr_record_value\n");
+        return 1;
+    }
+    hdr_reset(latency);
+    hdr_reset(success);
+
+    printf("hdr_record: %"PRIu64" iterations\n", n);
+
+    b = bench_start();
+    for (uint64_t i = 0; i < n; i++) {
+        hdr_record_value(latency, values[i & (VALUES - 1)]);
+    }
+    bench_report(&b, "hdr_record_value", n);
+
+    hdr_reset(latency);
+    b = bench_start();
+    for (uint64_t i = 0; i < n; i++) {
+        hdr_record_value_fast(latency, values[i & (VALUES - 1)]);
+    }
+    bench_report(&b, "hdr_record_value_fast", n);
+
+    hdr_reset(latency);
+    b = bench_start();
+    for (uint64_t i = 0; i < n; i++) {
+        int64_t v = values[i & (VALUES - 1)];
+        hdr_record_value(latency, v);
+        hdr_record_value(success, v);
+        hdr_record_value(u_latency, u_values[i & (VALUES - 1)]);
+    }
+    bench_report(&b, "response, hdr_record_value", n);
+
+    hdr_reset(latency);
+    hdr_reset(success);
+    hdr_reset(u_latency);
+    b = bench_start();
+    for (uint64_t i = 0; i < n; i++) {
+        int32_t index   = hdr_counts_index(latency, values[i & (VALUES - 1)]);
+        int32_t u_index = hdr_counts_index(u_latency, u_values[i & (VALUES - 1)]);
+        hdr_record_index(latency, index);
+        hdr_record_index(success, index);
+        hdr_record_index(u_latency, u_index);
+    }
+    bench_report(&b, "response, shared index", n);
+
+    return 0;
+}
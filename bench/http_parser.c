@@ -0,0 +1,118 @@
+// Microbenchmark of parsing responses with http_parser, using a corpus
+// of typical response shapes and the same callbacks wrk installs.
+
+#include <string.h>
+
+#include "bench.h"
+#include "http_parser.h"
+
+typedef struct {
+    char *name;
+    char *data;
+} response;
+
+static response corpus[] = {
+    { "minimal", "HTTP/1.1 200 OK\r\n"
+                 "Content-Length: 2\r\n"
+                 "\r\n"
+                 "ok" },
+    { "typical", "HTTP/1.1 200 OK\r\n"
+                 "Server: nginx/1.25.3\r\n"
+                 "Date: Mon, 01 Jan 2024 00:00:00 GMT\r\n"
+                 "Content-Type: application/json; charset=utf-8\r\n"
+                 "Content-Length: 58\r\n"
+                 "Connection: keep-alive\r\n"
+                 "Cache-Control: no-cache, no-store, must-revalidate\r\n"
+                 "X-Request-Id: 4f1c7a8e-2b3d-4c5e-9f6a-7b8c9d0e1f2a\r\n"
+                 "\r\n"
+                 "{\"id\":12345,\"name\":\"benchmark\",\"tags\":[\"a\",\"b\"],\"ok\":true}" },
+    { "chunked", "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: text/plain\r\n"
+                 "Transfer-Encoding: chunked\r\n"
+                 "\r\n"
+                 "10\r\n0123456789abcdef\r\n"
+                 "10\r\n0123456789abcdef\r\n"
+                 "8\r\n01234567\r\n"
+                 "0\r\n\r\n" },
+    { "not modified", "HTTP/1.1 304 Not Modified\r\n"
+                      "ETag: \"5e2a1b3c\"\r\n"
+                      "Date: Mon, 01 Jan 2024 00:00:00 GMT\r\n"
+                      "\r\n" },
+    { "error", "HTTP/1.1 503 Service Unavailable\r\n"
+               "Content-Type: text/html\r\n"
+               "Content-Length: 19\r\n"
+               "Retry-After: 1\r\n"
+               "\r\n"
+               "Service Unavailable" },
+};
+
+static uint64_t complete, bytes;
+
+static int header_field(http_parser *parser, const char *at, size_t len) {
+    bytes += len;
+    return 0;
+}
+
+static int header_value(http_parser *parser, const char *at, size_t len) {
+    bytes += len;
+    return 0;
+}
+
+static int response_body(http_parser *parser, const char *at, size_t len) {
+    bytes += len;
+    return 0;
+}
+
+static int response_complete(http_parser *parser) {
+    complete++;
+    return 0;
+}
+
+static void run(char *name, http_parser_settings *settings, char *data, uint64_t n) {
+    size_t len = strlen(data);
+    http_parser parser;
+    char label[64];
+    bench b;
+
+    http_parser_init(&parser, HTTP_RESPONSE);
+    complete = 0;
+
+    b = bench_start();
+    for (uint64_t i = 0; i < n; i++) {
+        if (http_parser_execute(&parser, settings, data, len) != len) {
+            fprintf(stderr, "%s: %s\n", name, http_errno_name(HTTP_PARSER_ERRNO(&parser)));
+            exit(1);
+        }
+    }
+    snprintf(label, sizeof(label), "%s (%zu bytes)", name, len);
+    bench_report(&b, label, n);
+
+    if (complete != n) {
+        fprintf(stderr, "%s: parsed %"PRIu64" of %"PRIu64" responses\n", name, complete, n);
+        exit(1);
+    }
+}
+
+int main(int argc, char **argv) {
+    uint64_t n = bench_iterations(argc, argv, 2000000);
+    http_parser_settings settings = {
+        .on_message_complete = response_complete,
+    };
+
+    printf("http_parser: %"PRIu64" iterations\n", n);
+    for (size_t i = 0; i < sizeof(corpus) / sizeof(response); i++) {
+        run(corpus[i].name, &settings, corpus[i].data, n);
+    }
+
+    // Callbacks installed when the script has a response() function.
+    settings.on_header_field = header_field;
+    settings.on_header_value = header_value;
+    settings.on_body         = response_body;
+
+    printf("http_parser, with response callbacks:\n");
+    for (size_t i = 0; i < sizeof(corpus) / sizeof(response); i++) {
+        run(corpus[i].name, &settings, corpus[i].data, n);
+    }
+
+    return bytes == 0;
+}
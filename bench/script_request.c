@@ -0,0 +1,82 @@
+// Microbenchmark of generating requests with Lua: the default static
+// request, a request() building a new request each call with
+// wrk.format and one that also returns a tag.
+
+#include <string.h>
+
+#include "bench.h"
+#include "script.h"
+
+#define HEAP_ITERATIONS 10000
+
+// Defined by wrk.c for wrk.connect, which the benchmark does not use.
+char *g_local_ip = NULL;
+void bind_socket(int fd, sa_family_t family, const char *addr) { }
+
+typedef struct {
+    char *name;
+    char *source;
+} script;
+
+static script scripts[] = {
+    { "static", "" },
+    { "wrk.format", "local n = 0\n"
+                    "request = function()\n"
+                    "   n = n + 1\n"
+                    "   return wrk.format(nil, \"/item/\" .. n)\n"
+                    "end\n" },
+    { "wrk.format, tagged", "local n = 0\n"
+                            "request = function()\n"
+                            "   n = n + 1\n"
+                            "   return wrk.format(nil, \"/item/\" .. n), n % 2 == 0 and \"even\" or \"odd\"\n"
+                            "end\n" },
+};
+
+static double heap_bytes(lua_State *L) {
+    return lua_gc(L, LUA_GCCOUNT, 0) * 1024.0 + lua_gc(L, LUA_GCCOUNTB, 0);
+}
+
+static void run(script *script, uint64_t n) {
+    char *headers[] = { "Accept: application/json", "User-Agent: wrk", NULL };
+    lua_State *L = script_create(NULL, "http://localhost:8080/", headers);
+    char *buf = NULL;
+    size_t len = 0;
+    bench b;
+
+    if (luaL_dostring(L, script->source) || luaL_dostring(L, "wrk.init({})")) {
+        fprintf(stderr, "%s: %s\n", script->name, lua_tostring(L, -1));
+        exit(1);
+    }
+
+    // Bytes allocated on the Lua heap per request, with the collector
+    // stopped so nothing is reclaimed while measuring.
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    lua_gc(L, LUA_GCSTOP, 0);
+    double heap = heap_bytes(L);
+    for (uint64_t i = 0; i < HEAP_ITERATIONS; i++) {
+        script_request(L, &buf, &len);
+    }
+    heap = (heap_bytes(L) - heap) / HEAP_ITERATIONS;
+    lua_gc(L, LUA_GCRESTART, 0);
+
+    b = bench_start();
+    for (uint64_t i = 0; i < n; i++) {
+        script_request(L, &buf, &len);
+    }
+    bench_report(&b, script->name, n);
+    printf("  %-32s %10.2f lua bytes/op\n", "", heap);
+
+    free(buf);
+    lua_close(L);
+}
+
+int main(int argc, char **argv) {
+    uint64_t n = bench_iterations(argc, argv, 200000);
+
+    printf("script_request: %"PRIu64" iterations\n", n);
+    for (size_t i = 0; i < sizeof(scripts) / sizeof(script); i++) {
+        run(&scripts[i], n);
+    }
+
+    return 0;
+}
@@ -0,0 +1,9 @@
+-- example request template which varies the path and a header
+-- for each request without calling into Lua on the hot path
+-------------------------------------------------------------
+-- NOTE: {seq} counts per wrk thread, {rand:MIN:MAX} draws a
+-- uniform random integer from the thread's generator
+
+wrk.headers["X-Counter"] = "{seq}"
+
+request = wrk.template(nil, "/items/{rand:1:1000000}?u={seq}")
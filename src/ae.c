@@ -60,32 +60,105 @@
     #endif
 #endif
 
+/* File events live in a packed table of count slots, found through an
+ * open addressing hash of their fd. Descriptors are allocated across all
+ * the threads of the process, so indexing events by fd would size every
+ * loop for the highest descriptor of any of them; slots keep the memory
+ * of a loop proportional to the descriptors it watches. */
+static unsigned int aeSlotHash(aeEventLoop *eventLoop, int fd) {
+    return ((unsigned int) fd * 2654435769u) >> (32 - eventLoop->slotbits);
+}
+
+/* Return the position of fd in the hash, or -1 if it is not registered. */
+static int aeSlotFind(aeEventLoop *eventLoop, int fd) {
+    unsigned int mask = (1u << eventLoop->slotbits) - 1;
+    unsigned int i = aeSlotHash(eventLoop, fd);
+
+    while (eventLoop->slots[i] != -1) {
+        if (eventLoop->events[eventLoop->slots[i]].fd == fd) return i;
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+static void aeSlotInsert(aeEventLoop *eventLoop, int fd, int slot) {
+    unsigned int mask = (1u << eventLoop->slotbits) - 1;
+    unsigned int i = aeSlotHash(eventLoop, fd);
+
+    while (eventLoop->slots[i] != -1) i = (i + 1) & mask;
+    eventLoop->slots[i] = slot;
+}
+
+/* Remove the entry at position i, shifting back the entries after it
+ * that would no longer be found past the hole. */
+static void aeSlotRemove(aeEventLoop *eventLoop, unsigned int i) {
+    unsigned int mask = (1u << eventLoop->slotbits) - 1;
+    unsigned int j = i, k;
+
+    eventLoop->slots[i] = -1;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (eventLoop->slots[j] == -1) return;
+        k = aeSlotHash(eventLoop, eventLoop->events[eventLoop->slots[j]].fd);
+        if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j)) {
+            eventLoop->slots[i] = eventLoop->slots[j];
+            eventLoop->slots[j] = -1;
+            i = j;
+        }
+    }
+}
+
+/* Size the hash for twice setsize and index the registered events. */
+static int aeSlotRehash(aeEventLoop *eventLoop) {
+    int bits = 1, i;
+
+    while ((1 << bits) < eventLoop->setsize * 2) bits++;
+    zfree(eventLoop->slots);
+    if ((eventLoop->slots = zmalloc(sizeof(int) << bits)) == NULL) return AE_ERR;
+    eventLoop->slotbits = bits;
+    for (i = 0; i < (1 << bits); i++) eventLoop->slots[i] = -1;
+    for (i = 0; i < eventLoop->count; i++)
+        aeSlotInsert(eventLoop, eventLoop->events[i].fd, i);
+    return AE_OK;
+}
+
+static aeFileEvent *aeLookupFileEvent(aeEventLoop *eventLoop, int fd) {
+    int i = aeSlotFind(eventLoop, fd);
+    return i == -1 ? NULL : &eventLoop->events[eventLoop->slots[i]];
+}
+
+/* Create an event loop for about setsize file descriptors. The table of
+ * file events grows when more descriptors are registered, while at most
+ * setsize events are returned by each poll. */
 aeEventLoop *aeCreateEventLoop(int setsize) {
     aeEventLoop *eventLoop;
-    int i;
 
+    if (setsize < 1) setsize = 1;
     if ((eventLoop = zmalloc(sizeof(*eventLoop))) == NULL) goto err;
     eventLoop->events = zmalloc(sizeof(aeFileEvent)*setsize);
     eventLoop->fired = zmalloc(sizeof(aeFiredEvent)*setsize);
+    eventLoop->slots = NULL;
     if (eventLoop->events == NULL || eventLoop->fired == NULL) goto err;
     eventLoop->setsize = setsize;
+    eventLoop->maxevents = setsize;
+    eventLoop->count = 0;
+    if (aeSlotRehash(eventLoop) == AE_ERR) goto err;
     eventLoop->lastTime = time(NULL);
     eventLoop->timeEventHead = NULL;
     eventLoop->timeEventNextId = 0;
     eventLoop->stop = 0;
-    eventLoop->maxfd = -1;
     eventLoop->beforesleep = NULL;
+    eventLoop->beforesleepData = NULL;
+    eventLoop->lastFired = 0;
+    eventLoop->spin = 0;
     if (aeApiCreate(eventLoop) == -1) goto err;
-    /* Events with mask == AE_NONE are not set. So let's initialize the
-     * vector with it. */
-    for (i = 0; i < setsize; i++)
-        eventLoop->events[i].mask = AE_NONE;
     return eventLoop;
 
 err:
     if (eventLoop) {
         zfree(eventLoop->events);
         zfree(eventLoop->fired);
+        zfree(eventLoop->slots);
         zfree(eventLoop);
     }
     return NULL;
@@ -95,6 +168,7 @@ void aeDeleteEventLoop(aeEventLoop *eventLoop) {
     aeApiFree(eventLoop);
     zfree(eventLoop->events);
     zfree(eventLoop->fired);
+    zfree(eventLoop->slots);
     zfree(eventLoop);
 }
 
@@ -102,49 +176,69 @@ void aeStop(aeEventLoop *eventLoop) {
     eventLoop->stop = 1;
 }
 
+/* Double the table of file events, so that growth is amortized. */
+static int aeGrowSetSize(aeEventLoop *eventLoop) {
+    int setsize = eventLoop->setsize * 2;
+
+    if (aeApiResize(eventLoop, setsize) == -1) return AE_ERR;
+    eventLoop->events = zrealloc(eventLoop->events, sizeof(aeFileEvent)*setsize);
+    eventLoop->setsize = setsize;
+    return aeSlotRehash(eventLoop);
+}
+
 int aeCreateFileEvent(aeEventLoop *eventLoop, int fd, int mask,
         aeFileProc *proc, void *clientData)
 {
-    if (fd >= eventLoop->setsize) {
-        errno = ERANGE;
+    if (fd < 0) {
+        errno = EBADF;
         return AE_ERR;
     }
-    aeFileEvent *fe = &eventLoop->events[fd];
+    aeFileEvent *fe = aeLookupFileEvent(eventLoop, fd);
 
+    if (!fe && eventLoop->count == eventLoop->setsize &&
+            aeGrowSetSize(eventLoop) == AE_ERR) {
+        errno = ERANGE;
+        return AE_ERR;
+    }
     if (aeApiAddEvent(eventLoop, fd, mask) == -1)
         return AE_ERR;
+    if (!fe) {
+        fe = &eventLoop->events[eventLoop->count];
+        fe->fd = fd;
+        fe->mask = AE_NONE;
+        aeSlotInsert(eventLoop, fd, eventLoop->count++);
+    }
     fe->mask |= mask;
     if (mask & AE_READABLE) fe->rfileProc = proc;
     if (mask & AE_WRITABLE) fe->wfileProc = proc;
     fe->clientData = clientData;
-    if (fd > eventLoop->maxfd)
-        eventLoop->maxfd = fd;
     return AE_OK;
 }
 
 void aeDeleteFileEvent(aeEventLoop *eventLoop, int fd, int mask)
 {
-    if (fd >= eventLoop->setsize) return;
-    aeFileEvent *fe = &eventLoop->events[fd];
+    int i = aeSlotFind(eventLoop, fd);
+    if (i == -1) return;
+    int slot = eventLoop->slots[i], last = eventLoop->count - 1;
+    aeFileEvent *fe = &eventLoop->events[slot];
 
-    if (fe->mask == AE_NONE) return;
     fe->mask = fe->mask & (~mask);
-    if (fd == eventLoop->maxfd && fe->mask == AE_NONE) {
-        /* Update the max fd */
-        int j;
+    aeApiDelEvent(eventLoop, fd, mask);
+    if (fe->mask != AE_NONE) return;
 
-        for (j = eventLoop->maxfd-1; j >= 0; j--)
-            if (eventLoop->events[j].mask != AE_NONE) break;
-        eventLoop->maxfd = j;
+    /* Free the slot, moving the last one into it to keep them packed. */
+    aeSlotRemove(eventLoop, i);
+    if (slot != last) {
+        eventLoop->slots[aeSlotFind(eventLoop, eventLoop->events[last].fd)] = slot;
+        eventLoop->events[slot] = eventLoop->events[last];
     }
-    aeApiDelEvent(eventLoop, fd, mask);
+    eventLoop->count--;
 }
 
 int aeGetFileEvents(aeEventLoop *eventLoop, int fd) {
-    if (fd >= eventLoop->setsize) return 0;
-    aeFileEvent *fe = &eventLoop->events[fd];
+    aeFileEvent *fe = aeLookupFileEvent(eventLoop, fd);
 
-    return fe->mask;
+    return fe ? fe->mask : 0;
 }
 
 static void aeGetTime(long *seconds, long *milliseconds)
@@ -156,6 +250,44 @@ static void aeGetTime(long *seconds, long *milliseconds)
     *milliseconds = tv.tv_usec/1000;
 }
 
+static long long aeUstime(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return ((long long)tv.tv_sec)*1000000 + tv.tv_usec;
+}
+
+/* Poll without sleeping until some file event fires, the timeout expires
+ * or the spin time of the loop is spent, then sleep for what is left of
+ * the timeout. Spinning keeps the CPU out of idle states, so events are
+ * handled without the wake-up latency of a blocking poll. */
+static int aeApiPollSpin(aeEventLoop *eventLoop, struct timeval *tvp)
+{
+    struct timeval zero = { 0, 0 };
+    long long start = aeUstime(), now = start, timeout = -1, spin;
+    int numevents;
+
+    if (tvp) timeout = (long long)tvp->tv_sec*1000000 + tvp->tv_usec;
+    spin = eventLoop->spin;
+    if (timeout >= 0 && (spin == AE_SPIN_ALWAYS || spin > timeout)) spin = timeout;
+
+    do {
+        numevents = aeApiPoll(eventLoop, &zero);
+        if (numevents || eventLoop->stop) return numevents;
+        now = aeUstime();
+    } while (spin == AE_SPIN_ALWAYS || now - start < spin);
+
+    if (timeout >= 0) {
+        timeout = timeout > now - start ? timeout - (now - start) : 0;
+        if (timeout == 0) return 0;
+        zero.tv_sec  = timeout / 1000000;
+        zero.tv_usec = timeout % 1000000;
+        return aeApiPoll(eventLoop, &zero);
+    }
+    return aeApiPoll(eventLoop, NULL);
+}
+
 static void aeAddMillisecondsToNow(long long milliseconds, long *sec, long *ms) {
     long cur_sec, cur_ms, when_sec, when_ms;
 
@@ -330,7 +462,7 @@ int aeProcessEvents(aeEventLoop *eventLoop, int flags)
      * file events to process as long as we want to process time
      * events, in order to sleep until the next time event is ready
      * to fire. */
-    if (eventLoop->maxfd != -1 ||
+    if (eventLoop->count > 0 ||
         ((flags & AE_TIME_EVENTS) && !(flags & AE_DONT_WAIT))) {
         int j;
         aeTimeEvent *shortest = NULL;
@@ -367,21 +499,27 @@ int aeProcessEvents(aeEventLoop *eventLoop, int flags)
             }
         }
 
-        numevents = aeApiPoll(eventLoop, tvp);
+        if (eventLoop->spin && !(flags & AE_DONT_WAIT))
+            numevents = aeApiPollSpin(eventLoop, tvp);
+        else
+            numevents = aeApiPoll(eventLoop, tvp);
+        eventLoop->lastFired = numevents;
         for (j = 0; j < numevents; j++) {
-            aeFileEvent *fe = &eventLoop->events[eventLoop->fired[j].fd];
             int mask = eventLoop->fired[j].mask;
             int fd = eventLoop->fired[j].fd;
+            aeFileEvent *fe = aeLookupFileEvent(eventLoop, fd);
             int rfired = 0;
 
 	    /* note the fe->mask & mask & ... code: maybe an already processed
              * event removed an element that fired and we still didn't
              * processed, so we check if the event is still valid. */
-            if (fe->mask & mask & AE_READABLE) {
+            if (fe && fe->mask & mask & AE_READABLE) {
                 rfired = 1;
                 fe->rfileProc(eventLoop,fd,fe->clientData,mask);
+                /* The handler may have moved or removed the event. */
+                fe = aeLookupFileEvent(eventLoop, fd);
             }
-            if (fe->mask & mask & AE_WRITABLE) {
+            if (fe && fe->mask & mask & AE_WRITABLE) {
                 if (!rfired || fe->wfileProc != fe->rfileProc)
                     fe->wfileProc(eventLoop,fd,fe->clientData,mask);
             }
@@ -421,7 +559,7 @@ void aeMain(aeEventLoop *eventLoop) {
     eventLoop->stop = 0;
     while (!eventLoop->stop) {
         if (eventLoop->beforesleep != NULL)
-            eventLoop->beforesleep(eventLoop);
+            eventLoop->beforesleep(eventLoop, eventLoop->beforesleepData);
         aeProcessEvents(eventLoop, AE_ALL_EVENTS);
     }
 }
@@ -430,6 +568,25 @@ char *aeGetApiName(void) {
     return aeApiName();
 }
 
-void aeSetBeforeSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *beforesleep) {
+void aeSetBeforeSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *beforesleep, void *clientData) {
     eventLoop->beforesleep = beforesleep;
+    eventLoop->beforesleepData = clientData;
+}
+
+/* Return the microseconds left before the nearest timer fires, 0 if it is
+ * already due, or -1 if there are no timers. */
+long long aeTimeToNearestTimer(aeEventLoop *eventLoop) {
+    aeTimeEvent *nearest = aeSearchNearestTimer(eventLoop);
+    long long when, now;
+
+    if (!nearest) return -1;
+    when = nearest->when_sec * 1000000LL + nearest->when_ms * 1000LL;
+    now = aeUstime();
+    return when > now ? when - now : 0;
+}
+
+/* Poll for up to spin microseconds before sleeping, or never sleep with
+ * AE_SPIN_ALWAYS. Zero, the default, always sleeps. */
+void aeSetSpin(aeEventLoop *eventLoop, long long spin) {
+    eventLoop->spin = spin;
 }
@@ -47,6 +47,8 @@
 
 #define AE_NOMORE -1
 
+#define AE_SPIN_ALWAYS -1
+
 /* Macros */
 #define AE_NOTUSED(V) ((void) V)
 
@@ -56,10 +58,11 @@ struct aeEventLoop;
 typedef void aeFileProc(struct aeEventLoop *eventLoop, int fd, void *clientData, int mask);
 typedef int aeTimeProc(struct aeEventLoop *eventLoop, long long id, void *clientData);
 typedef void aeEventFinalizerProc(struct aeEventLoop *eventLoop, void *clientData);
-typedef void aeBeforeSleepProc(struct aeEventLoop *eventLoop);
+typedef void aeBeforeSleepProc(struct aeEventLoop *eventLoop, void *clientData);
 
 /* File event structure */
 typedef struct aeFileEvent {
+    int fd;
     int mask; /* one of AE_(READABLE|WRITABLE) */
     aeFileProc *rfileProc;
     aeFileProc *wfileProc;
@@ -85,16 +88,22 @@ typedef struct aeFiredEvent {
 
 /* State of an event based program */
 typedef struct aeEventLoop {
-    int maxfd;   /* highest file descriptor currently registered */
-    int setsize; /* max number of file descriptors tracked */
+    int count;   /* number of file descriptors registered */
+    int setsize; /* size of events, grown on demand to count */
+    int maxevents; /* size of fired, max number of events per poll */
     long long timeEventNextId;
     time_t lastTime;     /* Used to detect system clock skew */
-    aeFileEvent *events; /* Registered events */
+    aeFileEvent *events; /* Registered events, packed in count slots */
+    int *slots;  /* open addressing table of fd to slot in events */
+    int slotbits; /* log2 of the size of slots */
     aeFiredEvent *fired; /* Fired events */
     aeTimeEvent *timeEventHead;
     int stop;
     void *apidata; /* This is used for polling API specific data */
     aeBeforeSleepProc *beforesleep;
+    void *beforesleepData;
+    int lastFired; /* number of file events fired by the last poll */
+    long long spin; /* microseconds to poll before sleeping, or AE_SPIN_ALWAYS */
 } aeEventLoop;
 
 /* Prototypes */
@@ -113,6 +122,8 @@ int aeProcessEvents(aeEventLoop *eventLoop, int flags);
 int aeWait(int fd, int mask, long long milliseconds);
 void aeMain(aeEventLoop *eventLoop);
 char *aeGetApiName(void);
-void aeSetBeforeSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *beforesleep);
+void aeSetBeforeSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *beforesleep, void *clientData);
+long long aeTimeToNearestTimer(aeEventLoop *eventLoop);
+void aeSetSpin(aeEventLoop *eventLoop, long long spin);
 
 #endif
@@ -94,6 +94,11 @@ static int aeApiCreate(aeEventLoop *eventLoop) {
     return 0;
 }
 
+static int aeApiResize(aeEventLoop *eventLoop, int setsize) {
+    /* Nothing to resize here. */
+    return 0;
+}
+
 static void aeApiFree(aeEventLoop *eventLoop) {
     aeApiState *state = eventLoop->apidata;
 
@@ -156,7 +161,7 @@ static int aeApiAddEvent(aeEventLoop *eventLoop, int fd, int mask) {
      * must be sure to include whatever events are already associated when
      * we call port_associate() again.
      */
-    fullmask = mask | eventLoop->events[fd].mask;
+    fullmask = mask | aeGetFileEvents(eventLoop, fd);
     pfd = aeApiLookupPending(state, fd);
 
     if (pfd != -1) {
@@ -209,7 +214,7 @@ static void aeApiDelEvent(aeEventLoop *eventLoop, int fd, int mask) {
      * the fact that our caller has already updated the mask in the eventLoop.
      */
 
-    fullmask = eventLoop->events[fd].mask;
+    fullmask = aeGetFileEvents(eventLoop, fd);
     if (fullmask == AE_NONE) {
         /*
          * We're removing *all* events, so use port_dissociate to remove the
@@ -239,9 +244,12 @@ static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
     aeApiState *state = eventLoop->apidata;
     struct timespec timeout, *tsp;
     int mask, i;
-    uint_t nevents;
+    uint_t nevents, batchsz;
     port_event_t event[MAX_EVENT_BATCHSZ];
 
+    batchsz = eventLoop->maxevents < MAX_EVENT_BATCHSZ ?
+        eventLoop->maxevents : MAX_EVENT_BATCHSZ;
+
     /*
      * If we've returned fd events before, we must reassociate them with the
      * port now, before calling port_get().  See the block comment at the top of
@@ -277,7 +285,7 @@ static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
      * So if we get ETIME, we check nevents, too.
      */
     nevents = 1;
-    if (port_getn(state->portfd, event, MAX_EVENT_BATCHSZ, &nevents,
+    if (port_getn(state->portfd, event, batchsz, &nevents,
         tsp) == -1 && (errno != ETIME || nevents == 0)) {
         if (errno == ETIME || errno == EINTR)
             return 0;
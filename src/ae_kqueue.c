@@ -42,7 +42,7 @@ static int aeApiCreate(aeEventLoop *eventLoop) {
     aeApiState *state = zmalloc(sizeof(aeApiState));
 
     if (!state) return -1;
-    state->events = zmalloc(sizeof(struct kevent)*eventLoop->setsize);
+    state->events = zmalloc(sizeof(struct kevent)*eventLoop->maxevents);
     if (!state->events) {
         zfree(state);
         return -1;
@@ -58,6 +58,12 @@ static int aeApiCreate(aeEventLoop *eventLoop) {
     return 0;    
 }
 
+static int aeApiResize(aeEventLoop *eventLoop, int setsize) {
+    /* Ready events are returned in batches of maxevents, whatever the
+     * number of descriptors. */
+    return 0;
+}
+
 static void aeApiFree(aeEventLoop *eventLoop) {
     aeApiState *state = eventLoop->apidata;
 
@@ -103,10 +109,10 @@ static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
         struct timespec timeout;
         timeout.tv_sec = tvp->tv_sec;
         timeout.tv_nsec = tvp->tv_usec * 1000;
-        retval = kevent(state->kqfd, NULL, 0, state->events, eventLoop->setsize,
+        retval = kevent(state->kqfd, NULL, 0, state->events, eventLoop->maxevents,
                         &timeout);
     } else {
-        retval = kevent(state->kqfd, NULL, 0, state->events, eventLoop->setsize,
+        retval = kevent(state->kqfd, NULL, 0, state->events, eventLoop->maxevents,
                         NULL);
     }
 
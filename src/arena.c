@@ -0,0 +1,98 @@
+// Per-thread arenas for connections, their receive buffers and the
+// histograms a thread records into.
+//
+// Memory is mapped in chunks of whole 2MB pages, aligned so that the
+// kernel can back them with huge pages and the hot connection state of
+// a thread takes a few TLB entries instead of one per 4KB. Explicit huge
+// pages come from the hugetlbfs pool and fall back to transparent huge
+// pages when the pool is exhausted. Allocations are zeroed and are only
+// released together, when the arena is freed.
+
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+#include "zmalloc.h"
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#define ROUND_UP(n, align) (((n) + (align) - 1) & ~((size_t) (align) - 1))
+
+void arena_init(arena *a, int huge_pages) {
+    a->huge_pages = huge_pages;
+    a->chunks     = NULL;
+    a->mapped     = 0;
+    a->hugetlb    = 0;
+}
+
+// Map size bytes aligned to a 2MB boundary, trimming the excess of a
+// larger mapping since mmap only aligns to the base page size.
+static void *map_aligned(size_t size) {
+    size_t length = size + ARENA_PAGE_SIZE;
+    char *p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+
+    char *start = (char *) ROUND_UP((uintptr_t) p, ARENA_PAGE_SIZE);
+    if (start > p) munmap(p, start - p);
+    munmap(start + size, (p + length) - (start + size));
+    return start;
+}
+
+static arena_chunk *arena_map(arena *a, size_t size) {
+    arena_chunk *chunk = NULL;
+
+#ifdef MAP_HUGETLB
+    if (a->huge_pages == HUGE_PAGES_EXPLICIT) {
+        chunk = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (chunk != MAP_FAILED) {
+            a->hugetlb += size;
+            return chunk;
+        }
+    }
+#endif
+
+    if (!(chunk = map_aligned(size))) return NULL;
+#ifdef MADV_HUGEPAGE
+    if (a->huge_pages != HUGE_PAGES_OFF) madvise(chunk, size, MADV_HUGEPAGE);
+#endif
+    return chunk;
+}
+
+// Allocate size zeroed bytes aligned to a cache line. Requests larger
+// than a chunk get a chunk of their own.
+void *arena_alloc(arena *a, size_t size) {
+    arena_chunk *chunk = a->chunks;
+    size_t offset = chunk ? ROUND_UP(chunk->used, ARENA_ALIGN) : 0;
+
+    if (!chunk || offset + size > chunk->size) {
+        size_t length = ROUND_UP(ROUND_UP(sizeof(arena_chunk), ARENA_ALIGN) + size, ARENA_PAGE_SIZE);
+        if (!(chunk = arena_map(a, length))) return NULL;
+
+        chunk->next = a->chunks;
+        chunk->size = length;
+        chunk->used = sizeof(arena_chunk);
+        a->chunks   = chunk;
+        a->mapped  += length;
+        zmalloc_stat_mapped(length);
+
+        offset = ROUND_UP(chunk->used, ARENA_ALIGN);
+    }
+
+    chunk->used = offset + size;
+    return (char *) chunk + offset;
+}
+
+void arena_free(arena *a) {
+    arena_chunk *chunk = a->chunks;
+
+    while (chunk) {
+        arena_chunk *next = chunk->next;
+        zmalloc_stat_unmapped(chunk->size);
+        munmap(chunk, chunk->size);
+        chunk = next;
+    }
+    arena_init(a, a->huge_pages);
+}
@@ -0,0 +1,35 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+enum {
+    HUGE_PAGES_OFF,
+    HUGE_PAGES_TRANSPARENT,
+    HUGE_PAGES_EXPLICIT,
+};
+
+#define ARENA_PAGE_SIZE (2 * 1024 * 1024)
+#define ARENA_ALIGN     64
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+    size_t used;
+} arena_chunk;
+
+// Bump allocator for state that lives as long as a thread, owned and
+// used by that thread only.
+typedef struct {
+    int huge_pages;
+    arena_chunk *chunks;
+    size_t mapped;
+    size_t hugetlb;
+} arena;
+
+void arena_init(arena *, int);
+void *arena_alloc(arena *, size_t);
+void arena_free(arena *);
+
+#endif /* ARENA_H */
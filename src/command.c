@@ -0,0 +1,163 @@
+// Runtime control of a running benchmark over a Unix socket.
+//
+// Clients send one command per line and get a one line reply. The main
+// thread reads the socket and hands commands to the threads through a
+// lock-free queue per thread which their event loops poll, so changes
+// apply between events without stopping the loops.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "command.h"
+#include "zmalloc.h"
+
+bool command_push(command_queue *q, command *cmd) {
+    uint32_t tail = q->tail;
+    uint32_t head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+
+    if (tail - head == COMMAND_QUEUE_SIZE) return false;
+
+    q->commands[tail % COMMAND_QUEUE_SIZE] = *cmd;
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool command_pop(command_queue *q, command *cmd) {
+    uint32_t head = q->head;
+    uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+
+    if (head == tail) return false;
+
+    *cmd = q->commands[head % COMMAND_QUEUE_SIZE];
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Listen on path, replacing a stale socket left by an earlier run but
+// never any other kind of file. Returns -1 on failure.
+int command_listen(command_server *s, char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct stat st;
+
+    for (int i = 0; i < COMMAND_CLIENTS; i++) {
+        s->clients[i].fd = -1;
+    }
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    if (!stat(path, &st) && S_ISSOCK(st.st_mode)) unlink(path);
+
+    if ((s->fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) return -1;
+    if (bind(s->fd, (struct sockaddr *) &addr, sizeof(addr)) || listen(s->fd, COMMAND_CLIENTS)) {
+        close(s->fd);
+        s->fd = -1;
+        return -1;
+    }
+
+    fcntl(s->fd, F_SETFL, fcntl(s->fd, F_GETFL, 0) | O_NONBLOCK);
+    s->path = zstrdup(path);
+    return 0;
+}
+
+static void command_accept(command_server *s) {
+    int fd = accept(s->fd, NULL, NULL);
+    if (fd == -1) return;
+
+    for (int i = 0; i < COMMAND_CLIENTS; i++) {
+        command_client *c = &s->clients[i];
+        if (c->fd == -1) {
+            c->fd  = fd;
+            c->len = 0;
+            return;
+        }
+    }
+
+    command_reply(fd, "error: too many clients");
+    close(fd);
+}
+
+// Read what a client sent and run every complete line. Returns -1 once
+// the client has gone away.
+static int command_read(command_client *c, command_fn fn, void *data) {
+    ssize_t n = read(c->fd, c->line + c->len, sizeof(c->line) - c->len - 1);
+    char *line, *end;
+
+    if (n <= 0) return n == -1 && errno == EINTR ? 0 : -1;
+    c->len += n;
+    c->line[c->len] = '\0';
+
+    for (line = c->line; (end = strchr(line, '\n')); line = end + 1) {
+        *end = '\0';
+        if (end > line && end[-1] == '\r') end[-1] = '\0';
+        if (line[strspn(line, " \t")]) fn(c->fd, line, data);
+    }
+
+    c->len -= line - c->line;
+    memmove(c->line, line, c->len);
+
+    if (c->len == sizeof(c->line) - 1) {
+        command_reply(c->fd, "error: line too long");
+        return -1;
+    }
+    return 0;
+}
+
+// Wait up to timeout milliseconds for commands and run them with fn.
+void command_poll(command_server *s, int timeout, command_fn fn, void *data) {
+    struct pollfd pfds[COMMAND_CLIENTS + 1];
+    int n = 0;
+
+    pfds[n++] = (struct pollfd) { .fd = s->fd, .events = POLLIN };
+    for (int i = 0; i < COMMAND_CLIENTS; i++) {
+        pfds[n++] = (struct pollfd) { .fd = s->clients[i].fd, .events = POLLIN };
+    }
+
+    if (poll(pfds, n, timeout) <= 0) return;
+
+    for (int i = 0; i < COMMAND_CLIENTS; i++) {
+        command_client *c = &s->clients[i];
+        if (c->fd == -1 || !pfds[i + 1].revents) continue;
+        if (command_read(c, fn, data)) {
+            close(c->fd);
+            c->fd = -1;
+        }
+    }
+
+    if (pfds[0].revents & POLLIN) command_accept(s);
+}
+
+void command_reply(int fd, const char *fmt, ...) {
+    char line[COMMAND_LINE_MAX];
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line) - 1, fmt, ap);
+    va_end(ap);
+
+    n = n < 0 ? 0 : n < (int) sizeof(line) - 1 ? n : (int) sizeof(line) - 2;
+    line[n++] = '\n';
+    if (write(fd, line, n) != n) return;
+}
+
+void command_close(command_server *s) {
+    for (int i = 0; i < COMMAND_CLIENTS; i++) {
+        if (s->clients[i].fd != -1) close(s->clients[i].fd);
+    }
+    if (s->fd != -1) {
+        close(s->fd);
+        unlink(s->path);
+    }
+    zfree(s->path);
+}
@@ -0,0 +1,55 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum {
+    CMD_RATE = 1,
+    CMD_CONNECTIONS,
+    CMD_SNAPSHOT,
+    CMD_STOP,
+};
+
+#define COMMAND_QUEUE_SIZE 64
+#define COMMAND_CLIENTS    8
+#define COMMAND_LINE_MAX   256
+#define COMMAND_POLL_MS    10
+
+typedef struct {
+    int type;
+    uint64_t seq;
+    double value;
+} command;
+
+// Single producer, single consumer ring of commands. The main thread
+// pushes and the event loop of one thread pops, without locks.
+typedef struct {
+    command commands[COMMAND_QUEUE_SIZE];
+    uint32_t head;
+    uint32_t tail;
+} command_queue;
+
+bool command_push(command_queue *, command *);
+bool command_pop(command_queue *, command *);
+
+typedef struct {
+    int fd;
+    size_t len;
+    char line[COMMAND_LINE_MAX];
+} command_client;
+
+typedef struct {
+    int fd;
+    char *path;
+    command_client clients[COMMAND_CLIENTS];
+} command_server;
+
+typedef void (*command_fn)(int, char *, void *);
+
+int command_listen(command_server *, char *);
+void command_poll(command_server *, int, command_fn, void *);
+void command_reply(int, const char *, ...);
+void command_close(command_server *);
+
+#endif /* COMMAND_H */
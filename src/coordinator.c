@@ -0,0 +1,642 @@
+// Coordinated load generation across several wrk processes or hosts.
+//
+// A coordinator hands each worker the original command line along with
+// its index and the number of workers, waits until every worker has
+// finished warming up, starts them all at once, and then collects their
+// results. Messages are framed with an 8 byte header holding the message
+// type and payload length as big-endian 32 bit integers. Histograms are
+// sent in the standard HdrHistogram V2 compressed encoding so they can be
+// merged exactly.
+//
+// Remote workers only accept coordinators that know the shared secret in
+// WRK_SECRET: the worker sends a random challenge and expects its
+// HMAC-SHA256 keyed with the secret, so the secret never crosses the
+// network.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#include "coordinator.h"
+#include "hdr_histogram_log.h"
+#include "script.h"
+#include "zmalloc.h"
+
+#define CONTROL_HEADER     8
+#define CONTROL_NONCE      32
+#define CONTROL_AUTH_SECS  10
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static int write_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p   += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *data, size_t len) {
+    char *p = data;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p   += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int control_send(int fd, uint32_t type, const void *data, size_t len) {
+    uint8_t header[CONTROL_HEADER];
+    put_u32(header, type);
+    put_u32(header + 4, len);
+    if (write_all(fd, header, sizeof(header))) return -1;
+    return write_all(fd, data, len);
+}
+
+// Receive one message of at most max bytes. The payload is NUL
+// terminated, allocated with zmalloc and owned by the caller. Returns -1
+// on EOF or a bad frame.
+int control_recv(int fd, uint32_t *type, char **data, size_t *len, size_t max) {
+    uint8_t header[CONTROL_HEADER];
+
+    if (read_all(fd, header, sizeof(header))) return -1;
+    *type = get_u32(header);
+    *len  = get_u32(header + 4);
+    if (*len > max) return -1;
+
+    *data = zmalloc(*len + 1);
+    if (read_all(fd, *data, *len)) {
+        zfree(*data);
+        return -1;
+    }
+    (*data)[*len] = '\0';
+    return 0;
+}
+
+// Split "[host:]port" into its parts, host is NULL when missing.
+static char *split_addr(char *addr, char **port) {
+    char *host = zstrdup(addr);
+    char *colon = strrchr(host, ':');
+
+    if (!colon) {
+        *port = host;
+        return NULL;
+    }
+    *colon = '\0';
+    *port  = colon + 1;
+    if (*host == '[' && colon[-1] == ']') {
+        colon[-1] = '\0';
+        memmove(host, host + 1, strlen(host));
+    }
+    return host;
+}
+
+int control_connect(char *addr) {
+    struct addrinfo *addrs, *a, hints = {
+        .ai_family   = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM
+    };
+    char *port, *host = split_addr(addr, &port);
+    int fd = -1, flags = 1;
+
+    if (!host || getaddrinfo(host, port, &hints, &addrs)) goto done;
+
+    for (a = addrs; a != NULL; a = a->ai_next) {
+        if ((fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol)) == -1) continue;
+        if (connect(fd, a->ai_addr, a->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+
+    if (fd != -1) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flags, sizeof(flags));
+
+  done:
+    zfree(host ? host : port);
+    return fd;
+}
+
+int control_listen(char *addr) {
+    struct addrinfo *addrs, *a, hints = {
+        .ai_family   = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags    = AI_PASSIVE
+    };
+    char *port, *host = split_addr(addr, &port);
+    int fd = -1, flags = 1;
+
+    // Listening on every interface must be asked for explicitly.
+    if (getaddrinfo(host ? host : "127.0.0.1", port, &hints, &addrs)) goto done;
+
+    for (a = addrs; a != NULL; a = a->ai_next) {
+        if ((fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol)) == -1) continue;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flags, sizeof(flags));
+        if (!bind(fd, a->ai_addr, a->ai_addrlen) && !listen(fd, 16)) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+
+  done:
+    zfree(host ? host : port);
+    return fd;
+}
+
+// The shared secret of coordinators and remote workers, NULL if unset.
+static char *control_secret() {
+    char *secret = getenv("WRK_SECRET");
+    return secret && *secret ? secret : NULL;
+}
+
+static void control_mac(char *secret, uint8_t *nonce, uint8_t *mac) {
+    unsigned int len = EVP_MAX_MD_SIZE;
+    HMAC(EVP_sha256(), secret, strlen(secret), nonce, CONTROL_NONCE, mac, &len);
+}
+
+// Challenge a coordinator to prove it knows the secret, waiting at most
+// CONTROL_AUTH_SECS for its answer, and tell it whether it passed.
+// Returns -1 if it did not.
+static int control_auth_serve(int fd, char *secret) {
+    struct timeval timeout = { .tv_sec = CONTROL_AUTH_SECS };
+    uint8_t nonce[CONTROL_NONCE], mac[EVP_MAX_MD_SIZE];
+    uint32_t type;
+    char *data;
+    size_t len;
+    int rc = -1;
+
+    if (RAND_bytes(nonce, sizeof(nonce)) != 1) return -1;
+    if (control_send(fd, MSG_CHALLENGE, nonce, sizeof(nonce))) return -1;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (control_recv(fd, &type, &data, &len, CONTROL_NONCE)) return -1;
+
+    control_mac(secret, nonce, mac);
+    if (type == MSG_AUTH && len == CONTROL_NONCE && !CRYPTO_memcmp(data, mac, CONTROL_NONCE)) rc = 0;
+    zfree(data);
+
+    timeout.tv_sec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (rc) {
+        char *msg = "authentication failed";
+        control_send(fd, MSG_ERROR, msg, strlen(msg));
+        return -1;
+    }
+    return control_send(fd, MSG_AUTH, NULL, 0);
+}
+
+// Answer the challenge of a remote worker. Returns -1 on failure.
+static int control_auth_connect(int fd, char *secret) {
+    uint8_t mac[EVP_MAX_MD_SIZE];
+    uint32_t type;
+    char *data;
+    size_t len;
+
+    if (control_recv(fd, &type, &data, &len, CONTROL_NONCE)) return -1;
+    if (type != MSG_CHALLENGE || len != CONTROL_NONCE) {
+        zfree(data);
+        return -1;
+    }
+    control_mac(secret, (uint8_t *) data, mac);
+    zfree(data);
+    if (control_send(fd, MSG_AUTH, mac, CONTROL_NONCE)) return -1;
+
+    if (control_recv(fd, &type, &data, &len, CONTROL_NONCE)) return -1;
+    zfree(data);
+    return type == MSG_AUTH ? 0 : -1;
+}
+
+static void control_args_encode(buffer *b, uint32_t index, uint32_t count, int argc, char **argv) {
+    uint8_t header[12];
+    put_u32(header, index);
+    put_u32(header + 4, count);
+    put_u32(header + 8, argc);
+    buffer_append(b, (char *) header, sizeof(header));
+    for (int i = 0; i < argc; i++) {
+        buffer_append(b, argv[i], strlen(argv[i]) + 1);
+    }
+}
+
+// Decode an ARGS message in place, argv points into data and must be
+// freed with zfree. Returns -1 if the message is malformed.
+int control_args_decode(char *data, size_t len, uint32_t *index, uint32_t *count, int *argc, char ***argv) {
+    uint8_t *p = (uint8_t *) data;
+    char *end = data + len;
+
+    if (len < 12) return -1;
+    *index = get_u32(p);
+    *count = get_u32(p + 4);
+    *argc  = get_u32(p + 8);
+    if (*index >= *count || *argc < 1 || (size_t) *argc > len) return -1;
+
+    *argv = zcalloc((*argc + 1) * sizeof(char *));
+    char *arg = data + 12;
+    for (int i = 0; i < *argc; i++) {
+        char *nul = memchr(arg, '\0', end - arg);
+        if (arg >= end || !nul) {
+            zfree(*argv);
+            return -1;
+        }
+        (*argv)[i] = arg;
+        arg = nul + 1;
+    }
+    return 0;
+}
+
+static void put_u64(buffer *b, uint64_t v) {
+    uint8_t bytes[8];
+    put_u32(bytes, v >> 32);
+    put_u32(bytes + 4, v);
+    buffer_append(b, (char *) bytes, sizeof(bytes));
+}
+
+static void put_string(buffer *b, const char *data, size_t len) {
+    uint8_t bytes[4];
+    put_u32(bytes, len);
+    buffer_append(b, (char *) bytes, sizeof(bytes));
+    buffer_append(b, data, len);
+}
+
+static void put_histogram(buffer *b, struct hdr_histogram *h) {
+    uint8_t *data;
+    size_t len;
+
+    if (hdr_encode_compressed(h, &data, &len)) {
+        fprintf(stderr, "unable to encode histogram\n");
+        exit(1);
+    }
+    put_string(b, (char *) data, len);
+    free(data);
+}
+
+void results_encode(results *r, buffer *b) {
+    put_u64(b, r->runtime_us);
+    put_u64(b, r->complete);
+    put_u64(b, r->bytes);
+
+    put_u64(b, r->errors.connect);
+    put_u64(b, r->errors.read);
+    put_u64(b, r->errors.write);
+    put_u64(b, r->errors.status);
+    put_u64(b, r->errors.timeout);
+    put_u64(b, r->errors.established);
+    put_u64(b, r->errors.reconnect);
+    put_u64(b, r->errors.range);
+    put_u64(b, r->errors.unanswered);
+
+    put_u64(b, r->statuses.other);
+    for (int i = 0; i <= STATUS_MAX - STATUS_MIN; i++) {
+        put_u64(b, r->statuses.codes[i]);
+    }
+
+    put_histogram(b, r->latency_histogram);
+    put_histogram(b, r->u_latency_histogram);
+    put_histogram(b, r->success_histogram);
+    put_histogram(b, r->error_histogram);
+    put_histogram(b, r->requests_histogram);
+
+    put_u64(b, r->warmup_runtime_us);
+    put_u64(b, r->warmup_complete);
+    put_histogram(b, r->warmup_histogram);
+
+    put_u64(b, r->catch_up);
+    put_u64(b, r->dropped);
+    put_histogram(b, r->wire_histogram);
+
+    put_u64(b, r->tcp.samples);
+    put_u64(b, r->tcp.retransmits);
+    put_histogram(b, r->tcp.rtt);
+    put_histogram(b, r->tcp.rttvar);
+    put_histogram(b, r->tcp.cwnd);
+    put_histogram(b, r->tcp.unacked);
+
+    put_u64(b, r->gc.steps);
+    put_u64(b, r->gc.cycles);
+    put_u64(b, r->gc.automatic);
+    put_u64(b, r->gc.time);
+    put_histogram(b, r->gc.pauses);
+
+    put_u64(b, r->ntags);
+    for (int i = 0; i < r->ntags; i++) {
+        put_string(b, r->tags[i].name, strlen(r->tags[i].name));
+        put_histogram(b, r->tags[i].latency_histogram);
+        put_histogram(b, r->tags[i].u_latency_histogram);
+    }
+}
+
+typedef struct {
+    uint8_t *p;
+    uint8_t *end;
+    bool error;
+} reader;
+
+static uint8_t *get_bytes(reader *r, size_t len) {
+    uint8_t *p = r->p;
+    if (r->error || (size_t) (r->end - r->p) < len) {
+        r->error = true;
+        return NULL;
+    }
+    r->p += len;
+    return p;
+}
+
+static uint64_t get_u64(reader *r) {
+    uint8_t *p = get_bytes(r, 8);
+    return p ? ((uint64_t) get_u32(p) << 32) | get_u32(p + 4) : 0;
+}
+
+static uint8_t *get_string(reader *r, size_t *len) {
+    uint8_t *p = get_bytes(r, 4);
+    *len = p ? get_u32(p) : 0;
+    return get_bytes(r, *len);
+}
+
+static struct hdr_histogram *get_histogram(reader *r) {
+    struct hdr_histogram *h = NULL;
+    size_t len;
+    uint8_t *data = get_string(r, &len);
+
+    if (data && hdr_decode_compressed(data, len, &h)) r->error = true;
+    return h;
+}
+
+// Decode results sent by a worker. Returns -1 if the data is malformed.
+int results_decode(char *data, size_t len, results *res) {
+    reader r = { (uint8_t *) data, (uint8_t *) data + len, false };
+
+    memset(res, 0, sizeof(results));
+    res->runtime_us = get_u64(&r);
+    res->complete   = get_u64(&r);
+    res->bytes      = get_u64(&r);
+
+    res->errors.connect     = get_u64(&r);
+    res->errors.read        = get_u64(&r);
+    res->errors.write       = get_u64(&r);
+    res->errors.status      = get_u64(&r);
+    res->errors.timeout     = get_u64(&r);
+    res->errors.established = get_u64(&r);
+    res->errors.reconnect   = get_u64(&r);
+    res->errors.range       = get_u64(&r);
+    res->errors.unanswered  = get_u64(&r);
+
+    res->statuses.other = get_u64(&r);
+    for (int i = 0; i <= STATUS_MAX - STATUS_MIN; i++) {
+        res->statuses.codes[i] = get_u64(&r);
+    }
+
+    res->latency_histogram   = get_histogram(&r);
+    res->u_latency_histogram = get_histogram(&r);
+    res->success_histogram   = get_histogram(&r);
+    res->error_histogram     = get_histogram(&r);
+    res->requests_histogram  = get_histogram(&r);
+
+    res->warmup_runtime_us = get_u64(&r);
+    res->warmup_complete   = get_u64(&r);
+    res->warmup_histogram  = get_histogram(&r);
+
+    res->catch_up = get_u64(&r);
+    res->dropped  = get_u64(&r);
+    res->wire_histogram = get_histogram(&r);
+
+    res->tcp.samples     = get_u64(&r);
+    res->tcp.retransmits = get_u64(&r);
+    res->tcp.rtt         = get_histogram(&r);
+    res->tcp.rttvar      = get_histogram(&r);
+    res->tcp.cwnd        = get_histogram(&r);
+    res->tcp.unacked     = get_histogram(&r);
+
+    res->gc.steps     = get_u64(&r);
+    res->gc.cycles    = get_u64(&r);
+    res->gc.automatic = get_u64(&r);
+    res->gc.time      = get_u64(&r);
+    res->gc.pauses    = get_histogram(&r);
+
+    uint64_t ntags = get_u64(&r);
+    if (ntags > MAX_TAGS) return -1;
+
+    for (uint64_t i = 0; i < ntags && !r.error; i++) {
+        tag *tag = &res->tags[res->ntags++];
+        size_t len;
+        uint8_t *name = get_string(&r, &len);
+        tag->name = zcalloc(len + 1);
+        if (name) memcpy(tag->name, name, len);
+        tag->latency_histogram   = get_histogram(&r);
+        tag->u_latency_histogram = get_histogram(&r);
+    }
+
+    return r.error || r.p != r.end ? -1 : 0;
+}
+
+static size_t csv_count(char *s) {
+    size_t n = 0;
+    for (char *p = s; p && *p; p++) {
+        if (*p == ',') n++;
+    }
+    return s && *s ? n + 1 : 0;
+}
+
+static void worker_fail(size_t i, char *msg) {
+    fprintf(stderr, "worker %zu: %s\n", i, msg);
+    exit(1);
+}
+
+// Start processes local workers plus one per host:port in the comma
+// separated workers list, run the benchmark on all of them and return
+// their results. SIGINT (via stop) ends the run early on every worker.
+results *coordinator_run(uint64_t processes, char *workers, int argc, char **argv,
+                         worker_fn worker, volatile sig_atomic_t *stop, size_t *count) {
+    size_t n = processes + csv_count(workers);
+    struct pollfd *fds = zcalloc(n * sizeof(struct pollfd));
+    pid_t *pids = zcalloc(n * sizeof(pid_t));
+    results *res = zcalloc(n * sizeof(results));
+    bool *done = zcalloc(n * sizeof(bool));
+
+    for (size_t i = 0; i < processes; i++) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+            fprintf(stderr, "unable to create worker socket: %s\n", strerror(errno));
+            exit(1);
+        }
+
+        // Buffered output, like the header of --hdr_log, belongs to the
+        // coordinator and must not be copied into the workers.
+        fflush(NULL);
+        if ((pids[i] = fork()) == 0) {
+            // Keep the report readable, only the coordinator prints.
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            for (size_t j = 0; j < i; j++) close(fds[j].fd);
+            close(sv[0]);
+            signal(SIGINT, SIG_IGN);
+            worker(sv[1]);
+            _exit(0);
+        } else if (pids[i] < 0) {
+            fprintf(stderr, "unable to fork worker: %s\n", strerror(errno));
+            exit(1);
+        }
+
+        close(sv[1]);
+        fds[i].fd = sv[0];
+    }
+
+    char *secret = control_secret();
+    if (n > processes && !secret) {
+        fprintf(stderr, "--workers requires the shared secret of the workers in WRK_SECRET\n");
+        exit(1);
+    }
+
+    char *list = workers ? zstrdup(workers) : NULL, *saveptr = NULL;
+    for (size_t i = processes; i < n; i++) {
+        char *addr = strtok_r(i == processes ? list : NULL, ",", &saveptr);
+        if (!addr || (fds[i].fd = control_connect(addr)) == -1) {
+            fprintf(stderr, "unable to connect to worker %s\n", addr ? addr : "");
+            exit(1);
+        }
+        if (control_auth_connect(fds[i].fd, secret)) {
+            fprintf(stderr, "unable to authenticate with worker %s\n", addr);
+            exit(1);
+        }
+    }
+    zfree(list);
+
+    for (size_t i = 0; i < n; i++) {
+        buffer b = { 0 };
+        control_args_encode(&b, i, n, argc, argv);
+        if (b.cursor - b.buffer > CONTROL_ARGS_MAX) worker_fail(i, "command line too long");
+        if (control_send(fds[i].fd, MSG_ARGS, b.buffer, b.cursor - b.buffer)) {
+            worker_fail(i, "unable to send arguments");
+        }
+        free(b.buffer);
+    }
+
+    // Start all workers at once, after the slowest one has warmed up.
+    for (size_t i = 0; i < n; i++) {
+        uint32_t type;
+        char *data;
+        size_t len;
+
+        if (control_recv(fds[i].fd, &type, &data, &len, CONTROL_RESULTS_MAX)) {
+            worker_fail(i, "exited during warmup");
+        }
+        if (type == MSG_ERROR) worker_fail(i, data);
+        if (type != MSG_READY) worker_fail(i, "unexpected message");
+        zfree(data);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        if (control_send(fds[i].fd, MSG_START, NULL, 0)) worker_fail(i, "unable to start");
+        fds[i].events = POLLIN;
+    }
+
+    size_t remaining = n;
+    bool stopping = false;
+
+    while (remaining > 0) {
+        if (*stop && !stopping) {
+            for (size_t i = 0; i < n; i++) {
+                if (!done[i]) control_send(fds[i].fd, MSG_STOP, NULL, 0);
+            }
+            stopping = true;
+        }
+
+        if (poll(fds, n, CONTROL_POLL_MS) <= 0) continue;
+
+        for (size_t i = 0; i < n; i++) {
+            uint32_t type;
+            char *data;
+            size_t len;
+
+            if (done[i] || !fds[i].revents) continue;
+            if (control_recv(fds[i].fd, &type, &data, &len, CONTROL_RESULTS_MAX)) {
+                worker_fail(i, "exited unexpectedly");
+            }
+            if (type == MSG_ERROR) worker_fail(i, data);
+            if (type != MSG_RESULTS || results_decode(data, len, &res[i])) {
+                worker_fail(i, "invalid results");
+            }
+            zfree(data);
+
+            close(fds[i].fd);
+            fds[i].fd = -1;
+            done[i]   = true;
+            remaining--;
+        }
+    }
+
+    for (size_t i = 0; i < processes; i++) {
+        waitpid(pids[i], NULL, 0);
+    }
+
+    zfree(fds);
+    zfree(pids);
+    zfree(done);
+
+    *count = n;
+    return res;
+}
+
+// Accept coordinators forever, running each request in a child process
+// once the coordinator is authenticated.
+void coordinator_serve(char *addr, worker_fn worker) {
+    char *secret = control_secret();
+    int fd;
+
+    if (!secret) {
+        fprintf(stderr, "--serve requires a shared secret in WRK_SECRET\n");
+        exit(1);
+    }
+
+    if ((fd = control_listen(addr)) == -1) {
+        fprintf(stderr, "unable to listen on %s: %s\n", addr, strerror(errno));
+        exit(1);
+    }
+
+    signal(SIGCHLD, SIG_IGN);
+    printf("Waiting for coordinators on %s\n", addr);
+    fflush(stdout);
+
+    for (;;) {
+        int c = accept(fd, NULL, NULL);
+        if (c == -1) continue;
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fd);
+            if (control_auth_serve(c, secret)) _exit(1);
+            worker(c);
+            _exit(0);
+        }
+        close(c);
+    }
+}
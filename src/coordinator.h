@@ -0,0 +1,38 @@
+#ifndef COORDINATOR_H
+#define COORDINATOR_H
+
+#include <signal.h>
+#include <stdint.h>
+#include "wrk.h"
+
+enum {
+    MSG_ARGS = 1,
+    MSG_READY,
+    MSG_START,
+    MSG_STOP,
+    MSG_RESULTS,
+    MSG_ERROR,
+    MSG_CHALLENGE,
+    MSG_AUTH,
+};
+
+#define CONTROL_POLL_MS     100
+#define CONTROL_ARGS_MAX    (16 * 1024)
+#define CONTROL_RESULTS_MAX (256 * 1024 * 1024)
+
+typedef void (*worker_fn)(int);
+
+int control_send(int, uint32_t, const void *, size_t);
+int control_recv(int, uint32_t *, char **, size_t *, size_t);
+int control_connect(char *);
+int control_listen(char *);
+
+int control_args_decode(char *, size_t, uint32_t *, uint32_t *, int *, char ***);
+
+void results_encode(results *, buffer *);
+int results_decode(char *, size_t, results *);
+
+results *coordinator_run(uint64_t, char *, int, char **, worker_fn, volatile sig_atomic_t *, size_t *);
+void coordinator_serve(char *, worker_fn);
+
+#endif /* COORDINATOR_H */
@@ -38,6 +38,23 @@ static int64_t power(int64_t base, int64_t exp)
     return result;
 }
 
+// determine exponent range needed to support the trackable value with no overflow:
+static int32_t buckets_needed_to_cover_value(int64_t sub_bucket_mask, int64_t value)
+{
+    int64_t trackable_value = sub_bucket_mask;
+    int32_t buckets_needed  = 1;
+    while (trackable_value < value)
+    {
+        if (trackable_value > INT64_MAX / 2)
+        {
+            return buckets_needed + 1;
+        }
+        trackable_value <<= 1;
+        buckets_needed++;
+    }
+    return buckets_needed;
+}
+
 static int32_t get_bucket_index(struct hdr_histogram* h, int64_t value)
 {
     int32_t pow2ceiling = 64 - __builtin_clzll(value | h->sub_bucket_mask); // smallest power of 2 containing value
@@ -124,11 +141,12 @@ static int64_t median_equivalent_value(struct hdr_histogram* h, int64_t value)
 // ##     ## ##       ##     ## ##     ## ##    ##     ##
 // ##     ## ######## ##     ##  #######  ##     ##    ##
 
-int hdr_init(
+// Compute the layout of a histogram into the header fields of h.
+static int hdr_layout(
         int64_t lowest_trackable_value,
         int64_t highest_trackable_value,
         int significant_figures,
-        struct hdr_histogram** result)
+        struct hdr_histogram* h)
 {
     if (significant_figures < 1 || 5 < significant_figures)
     {
@@ -145,18 +163,38 @@ int hdr_init(
     int32_t sub_bucket_half_count = sub_bucket_count / 2;
     int32_t sub_bucket_mask       = (sub_bucket_count - 1) << unit_magnitude;
 
-    // determine exponent range needed to support the trackable value with no overflow:
-    int64_t trackable_value = (int64_t) sub_bucket_mask;
-    int32_t buckets_needed  = 1;
-    while (trackable_value < highest_trackable_value)
+    int32_t bucket_count = buckets_needed_to_cover_value(sub_bucket_mask, highest_trackable_value);
+    int32_t counts_len   = (bucket_count + 1) * (sub_bucket_count / 2);
+
+    h->lowest_trackable_value          = lowest_trackable_value;
+    h->highest_trackable_value         = highest_trackable_value;
+    h->unit_magnitude                  = unit_magnitude;
+    h->significant_figures             = significant_figures;
+    h->sub_bucket_half_count_magnitude = sub_bucket_half_count_magnitude;
+    h->sub_bucket_half_count           = sub_bucket_half_count;
+    h->sub_bucket_mask                 = sub_bucket_mask;
+    h->sub_bucket_count                = sub_bucket_count;
+    h->bucket_count                    = bucket_count;
+    h->leading_zero_count_base         = 64 - unit_magnitude - (sub_bucket_half_count_magnitude + 1);
+    h->counts_len                      = counts_len;
+    h->total_count                     = 0;
+
+    return 0;
+}
+
+int hdr_init(
+        int64_t lowest_trackable_value,
+        int64_t highest_trackable_value,
+        int significant_figures,
+        struct hdr_histogram** result)
+{
+    size_t histogram_size = hdr_calculate_size(lowest_trackable_value, highest_trackable_value, significant_figures);
+
+    if (!histogram_size)
     {
-        trackable_value <<= 1;
-        buckets_needed++;
+        return EINVAL;
     }
-    int32_t bucket_count = buckets_needed;
-    int32_t counts_len   = (bucket_count + 1) * (sub_bucket_count / 2);
 
-    size_t histogram_size           = sizeof(struct hdr_histogram) + counts_len * sizeof(int64_t);
     struct hdr_histogram* histogram = (struct hdr_histogram*) malloc(histogram_size);
 
     if (!histogram)
@@ -165,24 +203,37 @@ int hdr_init(
     }
 
     memset((void*) histogram, 0, histogram_size);
-
-    histogram->lowest_trackable_value          = lowest_trackable_value;
-    histogram->highest_trackable_value         = highest_trackable_value;
-    histogram->unit_magnitude                  = unit_magnitude;
-    histogram->significant_figures             = significant_figures;
-    histogram->sub_bucket_half_count_magnitude = sub_bucket_half_count_magnitude;
-    histogram->sub_bucket_half_count           = sub_bucket_half_count;
-    histogram->sub_bucket_mask                 = sub_bucket_mask;
-    histogram->sub_bucket_count                = sub_bucket_count;
-    histogram->bucket_count                    = bucket_count;
-    histogram->counts_len                      = counts_len;
-    histogram->total_count                     = 0;
+    hdr_init_preallocated(lowest_trackable_value, highest_trackable_value, significant_figures, histogram);
 
     *result = histogram;
 
     return 0;
 }
 
+size_t hdr_calculate_size(
+        int64_t lowest_trackable_value,
+        int64_t highest_trackable_value,
+        int significant_figures)
+{
+    struct hdr_histogram layout;
+
+    if (hdr_layout(lowest_trackable_value, highest_trackable_value, significant_figures, &layout))
+    {
+        return 0;
+    }
+
+    return sizeof(struct hdr_histogram) + layout.counts_len * sizeof(int64_t);
+}
+
+int hdr_init_preallocated(
+        int64_t lowest_trackable_value,
+        int64_t highest_trackable_value,
+        int significant_figures,
+        struct hdr_histogram* h)
+{
+    return hdr_layout(lowest_trackable_value, highest_trackable_value, significant_figures, h);
+}
+
 
 int hdr_alloc(int64_t highest_trackable_value, int significant_figures, struct hdr_histogram** result)
 {
@@ -197,6 +248,41 @@ void hdr_reset(struct hdr_histogram *h)
      return;
 }
 
+int hdr_grow(struct hdr_histogram** h, int64_t highest_trackable_value)
+{
+    struct hdr_histogram* old = *h;
+
+    if (highest_trackable_value <= old->highest_trackable_value)
+    {
+        return 0;
+    }
+
+    // Buckets only ever extend the end of the counts array, so existing
+    // counts keep their index.
+    int32_t bucket_count = buckets_needed_to_cover_value(old->sub_bucket_mask, highest_trackable_value);
+    int32_t counts_len   = (bucket_count + 1) * old->sub_bucket_half_count;
+
+    struct hdr_histogram* histogram = realloc(old, sizeof(struct hdr_histogram) + counts_len * sizeof(int64_t));
+    if (!histogram)
+    {
+        return ENOMEM;
+    }
+
+    memset(&histogram->counts[histogram->counts_len], 0, (counts_len - histogram->counts_len) * sizeof(int64_t));
+    histogram->highest_trackable_value = highest_trackable_value;
+    histogram->bucket_count            = bucket_count;
+    histogram->counts_len              = counts_len;
+
+    *h = histogram;
+    return 0;
+}
+
+bool hdr_same_layout(const struct hdr_histogram* a, const struct hdr_histogram* b)
+{
+    return a->unit_magnitude == b->unit_magnitude &&
+        a->sub_bucket_half_count_magnitude == b->sub_bucket_half_count_magnitude;
+}
+
 size_t hdr_get_memory_size(struct hdr_histogram *h)
 {
     return sizeof(struct hdr_histogram) + h->counts_len * sizeof(int64_t);
@@ -266,6 +352,15 @@ bool hdr_record_corrected_value(struct hdr_histogram* h, int64_t value, int64_t
     return true;
 }
 
+int64_t hdr_add_grow(struct hdr_histogram** h, struct hdr_histogram* from)
+{
+    if (from->total_count > 0 && hdr_grow(h, hdr_max(from)) != 0)
+    {
+        return from->total_count;
+    }
+    return hdr_add(*h, from);
+}
+
 int64_t hdr_add(struct hdr_histogram* h, struct hdr_histogram* from)
 {
     struct hdr_recorded_iter iter;
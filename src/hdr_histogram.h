@@ -29,6 +29,7 @@ struct hdr_histogram
     int64_t sub_bucket_mask;
     int32_t sub_bucket_count;
     int32_t bucket_count;
+    int32_t leading_zero_count_base;
     int32_t counts_len;
     int64_t total_count;
     int64_t counts[0];
@@ -60,6 +61,32 @@ int hdr_init(
         int significant_figures,
         struct hdr_histogram** result);
 
+/**
+ * Calculate the size in bytes of a histogram allocated by hdr_init with the
+ * same parameters, so that the caller can allocate it.
+ *
+ * @return The size in bytes, or 0 if the significant_figure value is outside
+ * of the allowed range.
+ */
+size_t hdr_calculate_size(
+        int64_t lowest_trackable_value,
+        int64_t highest_trackable_value,
+        int significant_figures);
+
+/**
+ * Initialise a histogram in memory allocated by the caller, which must be
+ * zeroed and at least hdr_calculate_size bytes long.  The histogram cannot
+ * be freed or resized by this library afterwards.
+ *
+ * @return 0 on success, EINVAL if the significant_figure value is outside of
+ * the allowed range.
+ */
+int hdr_init_preallocated(
+        int64_t lowest_trackable_value,
+        int64_t highest_trackable_value,
+        int significant_figures,
+        struct hdr_histogram* h);
+
 /**
  * Allocate the memory and initialise the hdr_histogram.  This is the equivalent of calling
  * hdr_init(1, highest_trackable_value, significant_figures, result);
@@ -129,6 +156,76 @@ bool hdr_record_values(struct hdr_histogram* h, int64_t value, int64_t count);
  */
 bool hdr_record_corrected_value(struct hdr_histogram* h, int64_t value, int64_t expexcted_interval);
 
+/**
+ * Index into counts for a value, computed with a single count leading
+ * zeros and shift from the layout precomputed by hdr_init. Equivalent to
+ * the index used by hdr_record_value, but inline and without asserts so
+ * it can be used on hot recording paths.
+ *
+ * @param h "This" pointer
+ * @param value Value to find the index for
+ * @return The index, or a value >= h->counts_len (or negative) if the
+ * value can't be recorded.
+ */
+static inline int32_t hdr_counts_index(const struct hdr_histogram* h, int64_t value)
+{
+    int32_t bucket_index = h->leading_zero_count_base - __builtin_clzll(value | h->sub_bucket_mask);
+    int32_t sub_bucket_index = (int32_t) (value >> (bucket_index + h->unit_magnitude));
+    return ((bucket_index + 1) << h->sub_bucket_half_count_magnitude) + sub_bucket_index - h->sub_bucket_half_count;
+}
+
+/**
+ * Record a value at an index returned by hdr_counts_index. The index may
+ * be reused for any histogram with the same layout (see hdr_same_layout),
+ * so a value recorded in several histograms is only indexed once.
+ *
+ * @param h "This" pointer
+ * @param index Index from hdr_counts_index
+ * @return false if the index is out of range, true otherwise.
+ */
+static inline bool hdr_record_index(struct hdr_histogram* h, int32_t index)
+{
+    if ((uint32_t) index >= (uint32_t) h->counts_len)
+    {
+        return false;
+    }
+
+    h->counts[index]++;
+    h->total_count++;
+    return true;
+}
+
+/**
+ * Inline equivalent of hdr_record_value.
+ *
+ * @param h "This" pointer
+ * @param value Value to add to the histogram
+ * @return false if the value can't be recorded, true otherwise.
+ */
+static inline bool hdr_record_value_fast(struct hdr_histogram* h, int64_t value)
+{
+    return hdr_record_index(h, hdr_counts_index(h, value));
+}
+
+/**
+ * Whether two histograms map values to the same counts index, i.e. an
+ * index from hdr_counts_index of one can be used with the other. The
+ * range of the histograms may differ, hdr_record_index checks bounds.
+ */
+bool hdr_same_layout(const struct hdr_histogram* a, const struct hdr_histogram* b);
+
+/**
+ * Extend the range of a histogram to at least highest_trackable_value,
+ * keeping its precision and recorded values. The histogram may move, so
+ * *h is updated. Indices from hdr_counts_index remain valid.
+ *
+ * @param h Pointer to the histogram, updated on success
+ * @param highest_trackable_value The new highest value
+ * @return 0 on success (or if the range is already large enough), ENOMEM
+ * if realloc failed.
+ */
+int hdr_grow(struct hdr_histogram** h, int64_t highest_trackable_value);
+
 /**
  * Adds all of the values from 'from' to 'this' histogram.  Will return the
  * number of values that are dropped when copying.  Values will be dropped
@@ -141,6 +238,16 @@ bool hdr_record_corrected_value(struct hdr_histogram* h, int64_t value, int64_t
  */
 int64_t hdr_add(struct hdr_histogram* h, struct hdr_histogram* from);
 
+/**
+ * Like hdr_add, but grows 'this' histogram first so no values of 'from'
+ * are dropped for being above its highest_trackable_value.
+ *
+ * @param h Pointer to the histogram, updated if it grows
+ * @param from Histogram to copy values from.
+ * @return The number of values dropped when copying.
+ */
+int64_t hdr_add_grow(struct hdr_histogram** h, struct hdr_histogram* from);
+
 int64_t hdr_min(struct hdr_histogram* h);
 int64_t hdr_max(struct hdr_histogram* h);
 int64_t hdr_value_at_percentile(struct hdr_histogram* h, double percentile);
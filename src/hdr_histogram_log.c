@@ -0,0 +1,500 @@
+/**
+ * hdr_histogram_log.c
+ *
+ * V2 compressed encoding of histograms, compatible with the encoding used
+ * by HdrHistogram (Java) and HdrHistogram_c.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <zlib.h>
+
+#include "hdr_histogram.h"
+#include "hdr_histogram_log.h"
+
+#define V2_ENCODING_COOKIE            0x1c849303
+#define V2_COMPRESSION_COOKIE         0x1c849304
+// Bits 4-7 of a cookie hold the word size, which V2 ignores on read.
+#define COOKIE_WORD_SIZE              0x10
+#define COOKIE_BASE(cookie)           ((cookie) & ~0xf0)
+#define ENCODING_HEADER_SIZE          40
+#define COMPRESSION_HEADER_SIZE       8
+#define MAX_BYTES_LEB128              9
+#define LOG_LINE_MAX                  (1024 * 1024)
+
+
+// ########  ##    ## ######## ########  ######
+// ##     ##  ##  ##     ##    ##       ##    ##
+// ##     ##   ####      ##    ##       ##
+// ########     ##       ##    ######    ######
+// ##     ##    ##       ##    ##             ##
+// ##     ##    ##       ##    ##       ##    ##
+// ########     ##       ##    ########  ######
+
+
+static void put_u32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t) (v >> 24);
+    p[1] = (uint8_t) (v >> 16);
+    p[2] = (uint8_t) (v >> 8);
+    p[3] = (uint8_t) v;
+}
+
+static void put_u64(uint8_t* p, uint64_t v)
+{
+    put_u32(p, (uint32_t) (v >> 32));
+    put_u32(p + 4, (uint32_t) v);
+}
+
+static uint32_t get_u32(const uint8_t* p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static uint64_t get_u64(const uint8_t* p)
+{
+    return ((uint64_t) get_u32(p) << 32) | get_u32(p + 4);
+}
+
+static const char base64_table[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void base64_encode(const uint8_t* input, size_t length, char* output)
+{
+    size_t i;
+    for (i = 0; i + 2 < length; i += 3)
+    {
+        uint32_t v = ((uint32_t) input[i] << 16) | ((uint32_t) input[i + 1] << 8) | input[i + 2];
+        *output++ = base64_table[(v >> 18) & 0x3F];
+        *output++ = base64_table[(v >> 12) & 0x3F];
+        *output++ = base64_table[(v >> 6) & 0x3F];
+        *output++ = base64_table[v & 0x3F];
+    }
+
+    if (i < length)
+    {
+        uint32_t v = (uint32_t) input[i] << 16;
+        if (i + 1 < length)
+        {
+            v |= (uint32_t) input[i + 1] << 8;
+        }
+        *output++ = base64_table[(v >> 18) & 0x3F];
+        *output++ = base64_table[(v >> 12) & 0x3F];
+        *output++ = i + 1 < length ? base64_table[(v >> 6) & 0x3F] : '=';
+        *output++ = '=';
+    }
+
+    *output = '\0';
+}
+
+static int base64_value(char c)
+{
+    const char* p = c ? strchr(base64_table, c) : NULL;
+    return p ? (int) (p - base64_table) : -1;
+}
+
+static int base64_decode(const char* input, size_t length, uint8_t* output, size_t* output_len)
+{
+    size_t n = 0;
+
+    if (length % 4 != 0)
+    {
+        return EINVAL;
+    }
+
+    for (size_t i = 0; i < length; i += 4)
+    {
+        int a = base64_value(input[i]);
+        int b = base64_value(input[i + 1]);
+        int c = input[i + 2] == '=' ? 0 : base64_value(input[i + 2]);
+        int d = input[i + 3] == '=' ? 0 : base64_value(input[i + 3]);
+
+        if (a < 0 || b < 0 || c < 0 || d < 0)
+        {
+            return EINVAL;
+        }
+
+        uint32_t v = ((uint32_t) a << 18) | ((uint32_t) b << 12) | ((uint32_t) c << 6) | (uint32_t) d;
+        output[n++] = (uint8_t) (v >> 16);
+        if (input[i + 2] != '=')
+        {
+            output[n++] = (uint8_t) (v >> 8);
+        }
+        if (input[i + 3] != '=')
+        {
+            output[n++] = (uint8_t) v;
+        }
+    }
+
+    *output_len = n;
+    return 0;
+}
+
+static int zig_zag_encode_i64(uint8_t* buffer, int64_t signed_value)
+{
+    uint64_t value = ((uint64_t) signed_value << 1) ^ (uint64_t) (signed_value >> 63);
+    int bytes = 0;
+
+    while (bytes < MAX_BYTES_LEB128 - 1)
+    {
+        if ((value >> 7) == 0)
+        {
+            buffer[bytes++] = (uint8_t) value;
+            return bytes;
+        }
+        buffer[bytes++] = (uint8_t) ((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+
+    // The ninth byte carries a full 8 bits.
+    buffer[bytes++] = (uint8_t) value;
+    return bytes;
+}
+
+static int zig_zag_decode_i64(const uint8_t* buffer, size_t length, int64_t* signed_value)
+{
+    uint64_t value = 0;
+    int bytes = 0;
+
+    while (true)
+    {
+        if ((size_t) bytes >= length)
+        {
+            return -1;
+        }
+
+        uint8_t b = buffer[bytes];
+        if (bytes == MAX_BYTES_LEB128 - 1)
+        {
+            value |= (uint64_t) b << 56;
+            bytes++;
+            break;
+        }
+
+        value |= (uint64_t) (b & 0x7F) << (7 * bytes);
+        bytes++;
+        if (!(b & 0x80))
+        {
+            break;
+        }
+    }
+
+    *signed_value = (int64_t) ((value >> 1) ^ (~(value & 1) + 1));
+    return bytes;
+}
+
+
+// ######## ##    ##  ######   #######  ########  #### ##    ##  ######
+// ##       ###   ## ##    ## ##     ## ##     ##  ##  ###   ## ##    ##
+// ##       ####  ## ##       ##     ## ##     ##  ##  ####  ## ##
+// ######   ## ## ## ##       ##     ## ##     ##  ##  ## ## ## ##   ####
+// ##       ##  #### ##       ##     ## ##     ##  ##  ##  #### ##    ##
+// ##       ##   ### ##    ## ##     ## ##     ##  ##  ##   ### ##    ##
+// ######## ##    ##  ######   #######  ########  #### ##    ##  ######
+
+
+int hdr_encode_compressed(struct hdr_histogram* h, uint8_t** buffer, size_t* length)
+{
+    size_t encoded_max = ENCODING_HEADER_SIZE + (size_t) h->counts_len * MAX_BYTES_LEB128;
+    uint8_t* encoded   = malloc(encoded_max);
+    uint8_t* output    = NULL;
+    int rc = 0;
+
+    if (!encoded)
+    {
+        return ENOMEM;
+    }
+
+    // Trim trailing zero counts, runs of zeros are written as a negative count.
+    int32_t counts_limit = h->counts_len;
+    while (counts_limit > 0 && h->counts[counts_limit - 1] == 0)
+    {
+        counts_limit--;
+    }
+
+    size_t payload = 0;
+    uint8_t* counts = encoded + ENCODING_HEADER_SIZE;
+    for (int32_t i = 0; i < counts_limit; )
+    {
+        int64_t count = h->counts[i++];
+        if (count == 0)
+        {
+            int64_t zeros = 1;
+            while (i < counts_limit && h->counts[i] == 0)
+            {
+                zeros++;
+                i++;
+            }
+            count = -zeros;
+        }
+        payload += zig_zag_encode_i64(counts + payload, count);
+    }
+
+    double ratio = 1.0;
+    uint64_t ratio_bits;
+    memcpy(&ratio_bits, &ratio, sizeof(ratio_bits));
+
+    put_u32(encoded,      V2_ENCODING_COOKIE | COOKIE_WORD_SIZE);
+    put_u32(encoded + 4,  (uint32_t) payload);
+    put_u32(encoded + 8,  0);
+    put_u32(encoded + 12, (uint32_t) h->significant_figures);
+    put_u64(encoded + 16, (uint64_t) h->lowest_trackable_value);
+    put_u64(encoded + 24, (uint64_t) h->highest_trackable_value);
+    put_u64(encoded + 32, ratio_bits);
+
+    uLongf compressed_len = compressBound(ENCODING_HEADER_SIZE + payload);
+    if (!(output = malloc(COMPRESSION_HEADER_SIZE + compressed_len)))
+    {
+        rc = ENOMEM;
+        goto cleanup;
+    }
+
+    if (compress(output + COMPRESSION_HEADER_SIZE, &compressed_len, encoded, ENCODING_HEADER_SIZE + payload) != Z_OK)
+    {
+        rc = EIO;
+        goto cleanup;
+    }
+
+    put_u32(output,     V2_COMPRESSION_COOKIE | COOKIE_WORD_SIZE);
+    put_u32(output + 4, (uint32_t) compressed_len);
+
+    *buffer = output;
+    *length = COMPRESSION_HEADER_SIZE + compressed_len;
+    output  = NULL;
+
+cleanup:
+    free(encoded);
+    free(output);
+    return rc;
+}
+
+int hdr_decode_compressed(const uint8_t* buffer, size_t length, struct hdr_histogram** result)
+{
+    struct hdr_histogram* h = NULL;
+    uint8_t* encoded = NULL;
+    int rc = EINVAL;
+
+    if (length < COMPRESSION_HEADER_SIZE || COOKIE_BASE(get_u32(buffer)) != V2_COMPRESSION_COOKIE)
+    {
+        return EINVAL;
+    }
+
+    uint32_t compressed_len = get_u32(buffer + 4);
+    if (compressed_len > length - COMPRESSION_HEADER_SIZE)
+    {
+        return EINVAL;
+    }
+
+    // Inflate just the header first to learn the payload size.
+    uint8_t header[ENCODING_HEADER_SIZE];
+    z_stream strm = { 0 };
+    if (inflateInit(&strm) != Z_OK)
+    {
+        return ENOMEM;
+    }
+    strm.next_in   = (Bytef*) buffer + COMPRESSION_HEADER_SIZE;
+    strm.avail_in  = compressed_len;
+    strm.next_out  = header;
+    strm.avail_out = ENCODING_HEADER_SIZE;
+
+    int zrc = inflate(&strm, Z_SYNC_FLUSH);
+    if ((zrc != Z_OK && zrc != Z_STREAM_END) || strm.avail_out != 0 ||
+        COOKIE_BASE(get_u32(header)) != V2_ENCODING_COOKIE || get_u32(header + 8) != 0)
+    {
+        goto cleanup;
+    }
+
+    uint32_t payload        = get_u32(header + 4);
+    int significant_figures = (int) get_u32(header + 12);
+    int64_t lowest          = (int64_t) get_u64(header + 16);
+    int64_t highest         = (int64_t) get_u64(header + 24);
+
+    if (lowest < 1 || highest < 2 * lowest)
+    {
+        goto cleanup;
+    }
+
+    if ((rc = hdr_init(lowest, highest, significant_figures, &h)) != 0)
+    {
+        goto cleanup;
+    }
+    rc = EINVAL;
+
+    if (payload > (size_t) h->counts_len * MAX_BYTES_LEB128 || !(encoded = malloc(payload + 1)))
+    {
+        goto cleanup;
+    }
+
+    strm.next_out  = encoded;
+    strm.avail_out = payload;
+    zrc = inflate(&strm, Z_FINISH);
+    if (zrc != Z_STREAM_END || strm.avail_out != 0)
+    {
+        goto cleanup;
+    }
+
+    int32_t index = 0;
+    for (size_t offset = 0; offset < payload; )
+    {
+        int64_t count;
+        int n = zig_zag_decode_i64(encoded + offset, payload - offset, &count);
+        if (n < 0)
+        {
+            goto cleanup;
+        }
+        offset += n;
+
+        if (count < 0)
+        {
+            if (-count > h->counts_len - index)
+            {
+                goto cleanup;
+            }
+            index += (int32_t) -count;
+            continue;
+        }
+
+        if (index >= h->counts_len)
+        {
+            goto cleanup;
+        }
+        h->counts[index++] = count;
+        h->total_count    += count;
+    }
+
+    *result = h;
+    h  = NULL;
+    rc = 0;
+
+cleanup:
+    inflateEnd(&strm);
+    free(encoded);
+    free(h);
+    return rc;
+}
+
+
+// ##        #######   ######
+// ##       ##     ## ##    ##
+// ##       ##     ## ##
+// ##       ##     ## ##   ####
+// ##       ##     ## ##    ##
+// ##       ##     ## ##    ##
+// ########  #######   ######
+
+
+int hdr_log_write_header(FILE* file, const char* producer, double start_time)
+{
+    if (fprintf(file, "#[Histogram log format version 1.3]\n") < 0 ||
+        fprintf(file, "#[Logged with %s]\n", producer) < 0 ||
+        fprintf(file, "#[StartTime: %.3f (seconds since epoch)]\n", start_time) < 0 ||
+        fprintf(file, "\"StartTimestamp\",\"Interval_Length\",\"Interval_Max\",\"Interval_Compressed_Histogram\"\n") < 0)
+    {
+        return EIO;
+    }
+
+    return 0;
+}
+
+int hdr_log_write(
+    FILE* file, const char* tag, double start, double interval, struct hdr_histogram* h)
+{
+    uint8_t* encoded;
+    size_t length;
+    int rc;
+
+    if ((rc = hdr_encode_compressed(h, &encoded, &length)) != 0)
+    {
+        return rc;
+    }
+
+    char* base64 = malloc(((length + 2) / 3) * 4 + 1);
+    if (!base64)
+    {
+        free(encoded);
+        return ENOMEM;
+    }
+    base64_encode(encoded, length, base64);
+
+    if ((tag && fprintf(file, "Tag=%s,", tag) < 0) ||
+        fprintf(file, "%.3f,%.3f,%.3f,%s\n", start, interval, hdr_max(h) / 1000.0, base64) < 0)
+    {
+        rc = EIO;
+    }
+
+    free(base64);
+    free(encoded);
+    return rc;
+}
+
+int hdr_log_read(FILE* file, char* tag, size_t tag_len, struct hdr_histogram** result)
+{
+    char* line = malloc(LOG_LINE_MAX);
+    uint8_t* encoded = NULL;
+    int rc = EOF;
+
+    if (!line)
+    {
+        return ENOMEM;
+    }
+
+    while (fgets(line, LOG_LINE_MAX, file))
+    {
+        size_t len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        {
+            line[--len] = '\0';
+        }
+
+        if (len == 0 || line[0] == '#' || line[0] == '"')
+        {
+            continue;
+        }
+
+        rc = EINVAL;
+        char* p = line;
+        tag[0] = '\0';
+        if (!strncmp(p, "Tag=", 4))
+        {
+            char* comma = strchr(p, ',');
+            if (!comma || (size_t) (comma - p - 4) >= tag_len)
+            {
+                break;
+            }
+            memcpy(tag, p + 4, comma - p - 4);
+            tag[comma - p - 4] = '\0';
+            p = comma + 1;
+        }
+
+        // Skip the start, interval and max columns.
+        for (int i = 0; i < 3 && p; i++)
+        {
+            p = strchr(p, ',');
+            p = p ? p + 1 : NULL;
+        }
+        if (!p)
+        {
+            break;
+        }
+
+        size_t encoded_len;
+        if (!(encoded = malloc(strlen(p))))
+        {
+            rc = ENOMEM;
+            break;
+        }
+        if (base64_decode(p, strlen(p), encoded, &encoded_len) == 0)
+        {
+            rc = hdr_decode_compressed(encoded, encoded_len, result);
+        }
+        break;
+    }
+
+    free(encoded);
+    free(line);
+    return rc;
+}
@@ -0,0 +1,81 @@
+/**
+ * hdr_histogram_log.h
+ *
+ * Encoding and decoding of histograms in the standard compressed
+ * HdrHistogram V2 format, interoperable with the Java and C libraries.
+ *
+ * Like hdr_histogram.h this header does not include its dependencies:
+ *
+ * - #include <stdint.h>
+ * - #include <stddef.h>
+ * - #include <stdio.h>
+ * - #include "hdr_histogram.h"
+ */
+
+#ifndef HDR_HISTOGRAM_LOG_H
+#define HDR_HISTOGRAM_LOG_H 1
+
+/**
+ * Encode a histogram using the V2 compressed encoding: a ZigZag LEB128
+ * encoded, zero run-length compressed counts array deflated with zlib.
+ *
+ * @param h The histogram to encode
+ * @param buffer Output parameter, allocated with malloc
+ * @param length Output parameter, number of bytes in buffer
+ * @return 0 on success, ENOMEM or EIO on failure
+ */
+int hdr_encode_compressed(struct hdr_histogram* h, uint8_t** buffer, size_t* length);
+
+/**
+ * Decode a histogram encoded with hdr_encode_compressed (or any other
+ * implementation of the V2 compressed encoding).
+ *
+ * @param buffer The encoded histogram
+ * @param length Number of bytes in buffer
+ * @param result Output parameter, newly allocated histogram
+ * @return 0 on success, EINVAL if the data is malformed or ENOMEM
+ */
+int hdr_decode_compressed(const uint8_t* buffer, size_t length, struct hdr_histogram** result);
+
+/**
+ * Write the header of a histogram log file in the format read by
+ * HistogramLogReader and HistogramLogProcessor.
+ *
+ * @param file The file to write to
+ * @param producer Name of the program writing the log
+ * @param start_time Start time of the log, in seconds since the epoch
+ * @return 0 on success, EIO on failure
+ */
+int hdr_log_write_header(FILE* file, const char* producer, double start_time);
+
+/**
+ * Append a tagged histogram to a histogram log as a base64 encoded V2
+ * compressed histogram. The maximum value column is written in
+ * milliseconds, values are expected to be recorded in microseconds.
+ *
+ * @param file The file to write to
+ * @param tag Tag for the histogram, may be NULL. Must not contain ',' or
+ * whitespace.
+ * @param start Start of the interval, in seconds relative to the start time
+ * @param interval Length of the interval in seconds
+ * @param h The histogram to write
+ * @return 0 on success, ENOMEM or EIO on failure
+ */
+int hdr_log_write(
+    FILE* file, const char* tag, double start, double interval, struct hdr_histogram* h);
+
+/**
+ * Read the next histogram from a histogram log, skipping comments and
+ * the column header.
+ *
+ * @param file The file to read from
+ * @param tag Output parameter, the tag of the histogram or an empty
+ * string if it has none
+ * @param tag_len Size of the tag buffer
+ * @param result Output parameter, newly allocated histogram
+ * @return 0 on success, EOF at the end of the log, EINVAL if a line is
+ * malformed or ENOMEM
+ */
+int hdr_log_read(FILE* file, char* tag, size_t tag_len, struct hdr_histogram** result);
+
+#endif
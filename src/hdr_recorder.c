@@ -0,0 +1,141 @@
+/**
+ * hdr_recorder.c
+ *
+ * Writer/reader phaser and double-buffered histogram recorder.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "hdr_histogram.h"
+#include "hdr_recorder.h"
+
+
+// ########  ##     ##    ###     ######  ######## ########
+// ##     ## ##     ##   ## ##   ##    ## ##       ##     ##
+// ##     ## ##     ##  ##   ##  ##       ##       ##     ##
+// ########  ######### ##     ##  ######  ######   ########
+// ##        ##     ## #########       ## ##       ##   ##
+// ##        ##     ## ##     ## ##    ## ##       ##    ##
+// ##        ##     ## ##     ##  ######  ######## ##     ##
+
+
+int hdr_phaser_init(struct hdr_phaser* p)
+{
+    p->start_epoch    = 0;
+    p->even_end_epoch = 0;
+    p->odd_end_epoch  = INT64_MIN;
+
+    return pthread_mutex_init(&p->reader_mutex, NULL);
+}
+
+void hdr_phaser_destroy(struct hdr_phaser* p)
+{
+    pthread_mutex_destroy(&p->reader_mutex);
+}
+
+void hdr_phaser_reader_lock(struct hdr_phaser* p)
+{
+    pthread_mutex_lock(&p->reader_mutex);
+}
+
+void hdr_phaser_reader_unlock(struct hdr_phaser* p)
+{
+    pthread_mutex_unlock(&p->reader_mutex);
+}
+
+void hdr_phaser_flip_phase(struct hdr_phaser* p, int64_t sleep_time_us)
+{
+    // Writers entering the new phase see a start epoch with the opposite
+    // sign, and so exit through the other end epoch.
+    bool next_phase_is_even = __atomic_load_n(&p->start_epoch, __ATOMIC_SEQ_CST) < 0;
+    int64_t initial_start_value = next_phase_is_even ? 0 : INT64_MIN;
+
+    if (next_phase_is_even)
+    {
+        __atomic_store_n(&p->even_end_epoch, initial_start_value, __ATOMIC_SEQ_CST);
+    }
+    else
+    {
+        __atomic_store_n(&p->odd_end_epoch, initial_start_value, __ATOMIC_SEQ_CST);
+    }
+
+    int64_t start_value_at_flip = __atomic_exchange_n(&p->start_epoch, initial_start_value, __ATOMIC_SEQ_CST);
+    int64_t* end_epoch = next_phase_is_even ? &p->odd_end_epoch : &p->even_end_epoch;
+
+    while (__atomic_load_n(end_epoch, __ATOMIC_SEQ_CST) != start_value_at_flip)
+    {
+        if (sleep_time_us == 0)
+        {
+            sched_yield();
+        }
+        else
+        {
+            usleep(sleep_time_us);
+        }
+    }
+}
+
+
+// ########  ########  ######   #######  ########  ########  ######## ########
+// ##     ## ##       ##    ## ##     ## ##     ## ##     ## ##       ##     ##
+// ##     ## ##       ##       ##     ## ##     ## ##     ## ##       ##     ##
+// ########  ######   ##       ##     ## ########  ##     ## ######   ########
+// ##   ##   ##       ##       ##     ## ##   ##   ##     ## ##       ##   ##
+// ##    ##  ##       ##    ## ##     ## ##    ##  ##     ## ##       ##    ##
+// ##     ## ########  ######   #######  ##     ## ########  ######## ##     ##
+
+
+int hdr_recorder_init(
+    struct hdr_recorder* r,
+    int64_t lowest_trackable_value,
+    int64_t highest_trackable_value,
+    int significant_figures)
+{
+    int rc;
+
+    r->active   = NULL;
+    r->inactive = NULL;
+
+    if ((rc = hdr_init(lowest_trackable_value, highest_trackable_value, significant_figures, &r->active)) ||
+        (rc = hdr_init(lowest_trackable_value, highest_trackable_value, significant_figures, &r->inactive)) ||
+        (rc = hdr_phaser_init(&r->phaser)))
+    {
+        free(r->active);
+        free(r->inactive);
+        return rc;
+    }
+
+    return 0;
+}
+
+void hdr_recorder_destroy(struct hdr_recorder* r)
+{
+    hdr_phaser_destroy(&r->phaser);
+    free(r->active);
+    free(r->inactive);
+}
+
+struct hdr_histogram* hdr_recorder_sample(struct hdr_recorder* r)
+{
+    hdr_phaser_reader_lock(&r->phaser);
+
+    // The inactive histogram is only touched by readers, clear it and make
+    // it the target of new writes.
+    struct hdr_histogram* sample = r->inactive;
+    hdr_reset(sample);
+    r->inactive = __atomic_exchange_n(&r->active, sample, __ATOMIC_SEQ_CST);
+
+    hdr_phaser_flip_phase(&r->phaser, 0);
+
+    sample = r->inactive;
+    hdr_phaser_reader_unlock(&r->phaser);
+
+    return sample;
+}
@@ -0,0 +1,106 @@
+/**
+ * hdr_recorder.h
+ *
+ * A writer/reader phaser and a double-buffered histogram recorder built on
+ * it, after HdrHistogram's WriterReaderPhaser and Recorder.
+ *
+ * A single writer records into the active histogram of a recorder without
+ * locks, using two atomic increments to announce itself to the phaser. A
+ * reader on another thread can at any time swap the active and inactive
+ * histograms and wait for in-flight writes to drain, leaving it with a
+ * stable snapshot of the last interval while recording continues.
+ *
+ * Like hdr_histogram.h this header does not include its dependencies:
+ *
+ * - #include <stdint.h>
+ * - #include <stdbool.h>
+ * - #include <pthread.h>
+ * - #include "hdr_histogram.h"
+ */
+
+#ifndef HDR_RECORDER_H
+#define HDR_RECORDER_H 1
+
+struct hdr_phaser
+{
+    int64_t start_epoch;
+    int64_t even_end_epoch;
+    int64_t odd_end_epoch;
+    pthread_mutex_t reader_mutex;
+};
+
+struct hdr_recorder
+{
+    struct hdr_histogram* active;
+    struct hdr_histogram* inactive;
+    struct hdr_phaser phaser;
+};
+
+int hdr_phaser_init(struct hdr_phaser* p);
+void hdr_phaser_destroy(struct hdr_phaser* p);
+
+/**
+ * Enter a writer critical section. Wait free, the returned value must be
+ * passed to hdr_phaser_writer_exit.
+ */
+static inline int64_t hdr_phaser_writer_enter(struct hdr_phaser* p)
+{
+    return __atomic_fetch_add(&p->start_epoch, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline void hdr_phaser_writer_exit(struct hdr_phaser* p, int64_t critical_value_at_enter)
+{
+    int64_t* end_epoch = critical_value_at_enter < 0 ? &p->odd_end_epoch : &p->even_end_epoch;
+    __atomic_fetch_add(end_epoch, 1, __ATOMIC_SEQ_CST);
+}
+
+void hdr_phaser_reader_lock(struct hdr_phaser* p);
+void hdr_phaser_reader_unlock(struct hdr_phaser* p);
+
+/**
+ * Flip the phase and wait until every writer that entered the previous
+ * phase has left it. Must be called with the reader lock held.
+ *
+ * @param p "This" pointer
+ * @param sleep_time_us Time to sleep between checks, 0 to just yield
+ */
+void hdr_phaser_flip_phase(struct hdr_phaser* p, int64_t sleep_time_us);
+
+/**
+ * Allocate the active and inactive histograms of a recorder, see hdr_init
+ * for the parameters.
+ *
+ * @return 0 on success, EINVAL or ENOMEM on failure
+ */
+int hdr_recorder_init(
+    struct hdr_recorder* r,
+    int64_t lowest_trackable_value,
+    int64_t highest_trackable_value,
+    int significant_figures);
+
+void hdr_recorder_destroy(struct hdr_recorder* r);
+
+/**
+ * Record a value in the active histogram. Only one thread may record into
+ * a recorder.
+ *
+ * @return false if the value is out of range, true otherwise.
+ */
+static inline bool hdr_recorder_record_value(struct hdr_recorder* r, int64_t value)
+{
+    int64_t v = hdr_phaser_writer_enter(&r->phaser);
+    struct hdr_histogram* h = __atomic_load_n(&r->active, __ATOMIC_ACQUIRE);
+    bool recorded = hdr_record_value_fast(h, value);
+    hdr_phaser_writer_exit(&r->phaser, v);
+    return recorded;
+}
+
+/**
+ * Take a snapshot of the values recorded since the previous sample and
+ * start a new interval. The returned histogram belongs to the recorder and
+ * stays valid until the next call. Safe to call from any thread, but not
+ * from the recording thread.
+ */
+struct hdr_histogram* hdr_recorder_sample(struct hdr_recorder* r);
+
+#endif
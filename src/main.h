@@ -5,7 +5,9 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
 #include <math.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <stdarg.h>
@@ -20,6 +22,10 @@
 #include <sys/uio.h>
 
 #include "ssl.h"
+#include "command.h"
+#include "coordinator.h"
+#include "metrics.h"
+#include "responder.h"
 #include "aprintf.h"
 #include "stats.h"
 #include "units.h"
@@ -27,21 +33,75 @@
 
 struct config;
 
+static lua_State *benchmark(char *, struct http_parser_url *, char **, int, char **, results *);
+static void report(lua_State *, results *);
+static void open_hdr_log(char *);
+static char *self_test_start(struct http_parser_url *);
+static void self_test_report(results *);
+static void write_hdr_log(results *);
+static void log_interval(thread *, struct hdr_histogram *, uint64_t, uint64_t);
+static void supervise(thread *);
+static bool threads_command(thread *, command *);
+static void control_snapshot(int, thread *);
+static void control_command(int, char *, void *);
+static char *metrics_text(void *);
+static void latency_histogram_init(struct hdr_histogram **);
+static void results_init(results *);
+static void tcp_stats_init(tcp_stats *);
+static void tcp_stats_reset(tcp_stats *);
+static void tcp_stats_merge(tcp_stats *, tcp_stats *);
+static void gc_stats_reset(gc_stats *);
+static void gc_stats_merge(gc_stats *, gc_stats *);
+static void results_merge(results *, results *);
+static void coordinate(char *, char **, int, char **);
+static void worker_main(int);
+static void worker_run();
+
 static void *thread_main(void *);
+static void *thread_alloc(thread *, size_t);
+static void thread_histogram_init(thread *, struct hdr_histogram **, int64_t, int);
+static void connection_init(thread *, connection *, char *, size_t, double);
 static int connect_socket(thread *, connection *);
 static int reconnect_socket(thread *, connection *);
+#ifdef SO_BUSY_POLL
+static void set_busy_poll(int);
+#endif
 
 static int calibrate(aeEventLoop *, long long, void *);
+static void calibrate_thread(thread *);
+static void calibration_start(thread *);
+static void steady_start(thread *);
+static int scan_rate_range(char *, uint64_t *);
+static void connection_set_rate(connection *, double);
+static void thread_set_rate(thread *, double);
+static void warmup_start(thread *);
+static int warmup_tick(aeEventLoop *, long long, void *);
+static void warmup_end(thread *);
+static void thread_discard(thread *);
+static int steady_check(aeEventLoop *, long long, void *);
 static int sample_rate(aeEventLoop *, long long, void *);
+static int sample_tcp_info(aeEventLoop *, long long, void *);
+static void thread_gc(aeEventLoop *, void *);
 static int delayed_initial_connect(aeEventLoop *, long long, void *);
 static int check_stop(aeEventLoop *loop, long long id, void *data);
 static int warmup_timed_out(aeEventLoop *loop, long long id, void *data);
+static int inter_thread_sync(aeEventLoop *loop, long long id, void *data);
+static void thread_ready(thread *);
 
 static void socket_connected(aeEventLoop *, int, void *, int);
 static void socket_writeable(aeEventLoop *, int, void *, int);
 static void socket_readable(aeEventLoop *, int, void *, int);
 
 static int response_complete(http_parser *);
+static void record_latency(thread *, int, int64_t, uint64_t, bool, bool);
+static void record_pending(thread *, connection *, uint64_t);
+static void record_unanswered(thread *);
+static int thread_commands(aeEventLoop *, long long, void *);
+static void thread_set_connections(thread *, uint64_t);
+static bool record_index(struct hdr_histogram **, int32_t, int64_t);
+static bool record_value(struct hdr_histogram **, int64_t);
+static void drop_missed(connection *, uint64_t, uint64_t);
+static int scan_catch_up(char *);
 static int header_field(http_parser *, const char *, size_t);
 static int header_value(http_parser *, const char *, size_t);
 static int response_body(http_parser *, const char *, size_t);
@@ -53,5 +113,14 @@ static char *copy_url_part(char *, struct http_parser_url *, enum http_parser_ur
 static void print_stats_header();
 static void print_stats(char *, stats *, char *(*)(long double));
 static void print_hdr_latency(struct hdr_histogram*, const char*);
+static void print_statuses(statuses *);
+static void print_wire_latency(results *);
+static void print_percentile_row(char *, struct hdr_histogram *, char *(*)(long double));
+static void print_tcp_info(tcp_stats *);
+static void print_gc_stats(gc_stats *);
+static void print_latency_table(char *, char **, struct hdr_histogram **, int);
+static stats *histogram_stats(struct hdr_histogram *);
+static tag *tag_lookup(tag *, int *, const char *);
+static void tag_merge(tag *, int *, tag *);
 
 #endif /* MAIN_H */
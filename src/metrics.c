@@ -0,0 +1,121 @@
+// Embedded HTTP listener exposing live metrics for scraping by Prometheus
+// or any other OpenMetrics consumer. It serves one request per connection
+// from a dedicated thread, so slow scrapers never stall the event loops.
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "coordinator.h"
+#include "metrics.h"
+#include "zmalloc.h"
+
+typedef struct {
+    int fd;
+    metrics_fn fn;
+    void *data;
+} metrics_server;
+
+static void write_all(int fd, char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) continue;
+            return;
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+static void metrics_reply(int fd, int status, char *reason, char *type, char *body) {
+    char header[256];
+    size_t len = strlen(body);
+    int n = snprintf(header, sizeof(header),
+                     "HTTP/1.1 %d %s\r\n"
+                     "Content-Type: %s\r\n"
+                     "Content-Length: %zu\r\n"
+                     "Connection: close\r\n\r\n",
+                     status, reason, type, len);
+    write_all(fd, header, n);
+    write_all(fd, body, len);
+}
+
+// Read the request head and answer GET /metrics, anything else is 404.
+static void metrics_serve(metrics_server *s, int fd) {
+    struct timeval timeout = {
+        .tv_sec  = METRICS_TIMEOUT_MS / 1000,
+        .tv_usec = (METRICS_TIMEOUT_MS % 1000) * 1000
+    };
+    char request[2048];
+    size_t len = 0;
+    ssize_t n;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    do {
+        if ((n = read(fd, request + len, sizeof(request) - len - 1)) <= 0) return;
+        len += n;
+        request[len] = '\0';
+    } while (!strstr(request, "\r\n\r\n") && len < sizeof(request) - 1);
+
+    if (strncmp(request, "GET /metrics ", 13) && strncmp(request, "GET / ", 6)) {
+        metrics_reply(fd, 404, "Not Found", "text/plain", "not found\n");
+        return;
+    }
+
+    char *body = s->fn(s->data);
+    metrics_reply(fd, 200, "OK", METRICS_CONTENT_TYPE, body);
+    free(body);
+}
+
+static void *metrics_main(void *arg) {
+    metrics_server *s = arg;
+
+    for (;;) {
+        int fd = accept(s->fd, NULL, NULL);
+        if (fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            fprintf(stderr, "metrics listener failed: %s\n", strerror(errno));
+            break;
+        }
+        metrics_serve(s, fd);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+// Listen on [host:]port, localhost when no host is given, and serve the
+// text rendered by fn from a detached thread. Returns -1 on failure.
+int metrics_start(char *addr, metrics_fn fn, void *data) {
+    metrics_server *s = zcalloc(sizeof(metrics_server));
+    pthread_t thread;
+    char local[64];
+
+    if (!strchr(addr, ':')) {
+        snprintf(local, sizeof(local), "127.0.0.1:%s", addr);
+        addr = local;
+    }
+
+    s->fn   = fn;
+    s->data = data;
+    if ((s->fd = control_listen(addr)) == -1) goto error;
+
+    if (pthread_create(&thread, NULL, metrics_main, s)) {
+        close(s->fd);
+        goto error;
+    }
+    pthread_detach(thread);
+    return 0;
+
+  error:
+    zfree(s);
+    return -1;
+}
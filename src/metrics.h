@@ -0,0 +1,12 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#define METRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+#define METRICS_TIMEOUT_MS   1000
+
+// Render the metrics as text allocated with malloc.
+typedef char *(*metrics_fn)(void *);
+
+int metrics_start(char *, metrics_fn, void *);
+
+#endif /* METRICS_H */
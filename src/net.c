@@ -1,8 +1,16 @@
 // Copyright (C) 2013 - Will Glozer.  All rights reserved.
 
 #include <errno.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#endif
 
 #include "net.h"
 
@@ -37,3 +45,98 @@ size_t sock_readable(connection *c) {
     rc = ioctl(c->fd, FIONREAD, &n);
     return rc == -1 ? 0 : n;
 }
+
+#ifdef SO_TIMESTAMPING
+
+// Index of the timestamps used in struct scm_timestamping: 0 for
+// software timestamps and 2 for raw hardware ones.
+static int ts_index = 0;
+
+static uint64_t timespec_ns(struct timespec *ts) {
+    return ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+void sock_timestamps_init(bool hardware) {
+    ts_index = hardware ? 2 : 0;
+}
+
+// Ask the kernel to timestamp every segment received and the last byte
+// of every write, once the connection is established as required by
+// SOF_TIMESTAMPING_OPT_ID on TCP. Write timestamps are numbered by byte
+// offset from here.
+int sock_timestamps_enable(connection *c) {
+    int flags = SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+
+    if (ts_index == 2) {
+        flags |= SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_TX_HARDWARE |
+                 SOF_TIMESTAMPING_RX_HARDWARE;
+    } else {
+        flags |= SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE |
+                 SOF_TIMESTAMPING_RX_SOFTWARE;
+    }
+
+    c->tx_bytes   = 0;
+    c->tx_stamped = false;
+    return setsockopt(c->fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+}
+
+static uint64_t cmsg_timestamp(struct msghdr *msg, uint32_t *id) {
+    uint64_t timestamp = 0;
+
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm)) {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING) {
+            struct scm_timestamping *tss = (struct scm_timestamping *) CMSG_DATA(cm);
+            timestamp = timespec_ns(&tss->ts[ts_index]);
+        } else if (id && cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) {
+            *id = ((struct sock_extended_err *) CMSG_DATA(cm))->ee_data;
+        } else if (id && cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR) {
+            *id = ((struct sock_extended_err *) CMSG_DATA(cm))->ee_data;
+        }
+    }
+    return timestamp;
+}
+
+// Drain the write timestamps queued on the error queue, keeping the one
+// for the last byte of the latest request.
+void sock_tx_timestamps(connection *c) {
+    char control[512];
+    struct msghdr msg;
+    uint32_t id;
+
+    for (;;) {
+        msg = (struct msghdr) { .msg_control = control, .msg_controllen = sizeof(control) };
+        if (recvmsg(c->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) return;
+
+        id = UINT32_MAX;
+        uint64_t timestamp = cmsg_timestamp(&msg, &id);
+        // The kernel counts bytes in a 32-bit ee_data, wrapping past 4GiB.
+        if (timestamp && id == (uint32_t) c->tx_id) {
+            c->tx_timestamp = timestamp;
+            c->tx_stamped   = true;
+        }
+    }
+}
+
+// Read like sock_read, keeping the receive timestamp of the latest
+// segment read.
+status sock_read_timestamped(connection *c, size_t *n) {
+    char control[512];
+    struct iovec iov = { .iov_base = c->buf, .iov_len = sizeof(c->buf) };
+    struct msghdr msg = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = control,
+        .msg_controllen = sizeof(control)
+    };
+
+    ssize_t r = recvmsg(c->fd, &msg, 0);
+    if (r == -1) return errno == EAGAIN ? RETRY : ERROR;
+
+    uint64_t timestamp = cmsg_timestamp(&msg, NULL);
+    if (timestamp) c->rx_timestamp = timestamp;
+
+    *n = (size_t) r;
+    return OK;
+}
+
+#endif
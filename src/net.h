@@ -2,6 +2,7 @@
 #define NET_H
 
 #include "config.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <openssl/ssl.h>
 #include "wrk.h"
@@ -29,4 +30,11 @@ status sock_read(connection *, size_t *);
 status sock_write(connection *, char *, size_t, size_t *);
 size_t sock_readable(connection *);
 
+#ifdef SO_TIMESTAMPING
+void sock_timestamps_init(bool);
+int sock_timestamps_enable(connection *);
+void sock_tx_timestamps(connection *);
+status sock_read_timestamped(connection *, size_t *);
+#endif
+
 #endif /* NET_H */
@@ -0,0 +1,271 @@
+// Minimal HTTP/1.1 responder used to measure the latency and throughput
+// of wrk itself over loopback. Every request gets the same response of a
+// fixed size, optionally after a random delay.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "ae.h"
+#include "aprintf.h"
+#include "http_parser.h"
+#include "responder.h"
+#include "tinymt64.h"
+#include "zmalloc.h"
+
+#define RESPONDER_SETSIZE 1024
+#define RESPONDER_RECVBUF 8192
+
+typedef struct {
+    pthread_t thread;
+    aeEventLoop *loop;
+    tinymt64_t rand;
+    int listen_fd;
+} responder_thread;
+
+typedef struct {
+    int fd;
+    http_parser parser;
+    responder_thread *thread;
+    uint64_t ready;
+    uint64_t delayed;
+    size_t written;
+    bool writable;
+    bool closed;
+    char buf[RESPONDER_RECVBUF];
+} responder_conn;
+
+static struct {
+    responder_config cfg;
+    char *response;
+    size_t length;
+} responder;
+
+static char *dist_names[] = { "fixed", "uniform", "exponential", NULL };
+
+static void *responder_main(void *);
+static void responder_accept(aeEventLoop *, int, void *, int);
+static void responder_readable(aeEventLoop *, int, void *, int);
+static void responder_writeable(aeEventLoop *, int, void *, int);
+static int responder_delay_done(aeEventLoop *, long long, void *);
+static int request_complete(http_parser *);
+
+static http_parser_settings parser_settings = {
+    .on_message_complete = request_complete
+};
+
+int responder_parse_dist(char *name, delay_dist *dist) {
+    for (int i = 0; dist_names[i]; i++) {
+        if (!strcasecmp(name, dist_names[i])) {
+            *dist = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+char *responder_dist_name(delay_dist dist) {
+    return dist_names[dist];
+}
+
+static int responder_listen(char *host, char *port) {
+    struct addrinfo *addrs, *a, hints = {
+        .ai_family   = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags    = AI_PASSIVE
+    };
+    int fd = -1, flags = 1;
+
+    if (getaddrinfo(host, port, &hints, &addrs)) return -1;
+
+    for (a = addrs; a != NULL; a = a->ai_next) {
+        if ((fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol)) == -1) continue;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flags, sizeof(flags));
+        if (!bind(fd, a->ai_addr, a->ai_addrlen) && !listen(fd, SOMAXCONN)) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+
+    if (fd != -1) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+// Start the responder threads listening on host:port, all sharing one
+// listening socket. Returns the port bound, which is chosen by the
+// kernel when port is "0", or -1 on failure.
+int responder_start(responder_config *cfg, char *host, char *port) {
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    int fd;
+
+    if ((fd = responder_listen(host, port)) == -1) return -1;
+    if (getsockname(fd, (struct sockaddr *) &addr, &len)) return -1;
+
+    responder.cfg      = *cfg;
+    aprintf(&responder.response, "HTTP/1.1 200 OK\r\n"
+                                 "Content-Type: text/plain\r\n"
+                                 "Content-Length: %"PRIu64"\r\n"
+                                 "\r\n", cfg->size);
+    size_t header = strlen(responder.response);
+    responder.length   = header + cfg->size;
+    responder.response = realloc(responder.response, responder.length);
+    memset(responder.response + header, 'x', cfg->size);
+
+    responder_thread *threads = zcalloc(cfg->threads * sizeof(responder_thread));
+    for (uint64_t i = 0; i < cfg->threads; i++) {
+        responder_thread *t = &threads[i];
+        t->loop      = aeCreateEventLoop(RESPONDER_SETSIZE);
+        t->listen_fd = fd;
+        tinymt64_init(&t->rand, i + 1);
+
+        if (!t->loop || aeCreateFileEvent(t->loop, fd, AE_READABLE, responder_accept, t) != AE_OK ||
+            pthread_create(&t->thread, NULL, &responder_main, t)) {
+            return -1;
+        }
+    }
+
+    if (addr.ss_family == AF_INET6) {
+        return ntohs(((struct sockaddr_in6 *) &addr)->sin6_port);
+    }
+    return ntohs(((struct sockaddr_in *) &addr)->sin_port);
+}
+
+static void *responder_main(void *arg) {
+    responder_thread *t = arg;
+    aeMain(t->loop);
+    return NULL;
+}
+
+static void responder_accept(aeEventLoop *loop, int fd, void *data, int mask) {
+    responder_thread *t = data;
+    int flags = 1, cfd;
+
+    while ((cfd = accept(fd, NULL, NULL)) != -1) {
+        fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL, 0) | O_NONBLOCK);
+        setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &flags, sizeof(flags));
+
+        responder_conn *c = zcalloc(sizeof(responder_conn));
+        c->fd     = cfd;
+        c->thread = t;
+        http_parser_init(&c->parser, HTTP_REQUEST);
+        c->parser.data = c;
+
+        if (aeCreateFileEvent(loop, cfd, AE_READABLE, responder_readable, c) != AE_OK) {
+            close(cfd);
+            zfree(c);
+        }
+    }
+}
+
+// Connections with responses still waiting for their delay are freed
+// when the last delay expires.
+static void responder_close(responder_conn *c) {
+    aeDeleteFileEvent(c->thread->loop, c->fd, AE_READABLE | AE_WRITABLE);
+    close(c->fd);
+    c->closed = true;
+    if (!c->delayed) zfree(c);
+}
+
+static void responder_flush(responder_conn *c) {
+    aeEventLoop *loop = c->thread->loop;
+
+    while (c->ready) {
+        ssize_t n = write(c->fd, responder.response + c->written, responder.length - c->written);
+        if (n < 0) {
+            if (errno != EAGAIN) {
+                responder_close(c);
+                return;
+            }
+            if (!c->writable) {
+                aeCreateFileEvent(loop, c->fd, AE_WRITABLE, responder_writeable, c);
+                c->writable = true;
+            }
+            return;
+        }
+        c->written += n;
+        if (c->written == responder.length) {
+            c->written = 0;
+            c->ready--;
+        }
+    }
+
+    if (c->writable) {
+        aeDeleteFileEvent(loop, c->fd, AE_WRITABLE);
+        c->writable = false;
+    }
+}
+
+// Delay of the next response in milliseconds, the resolution of ae timers.
+static long long responder_delay(responder_thread *t) {
+    double delay = responder.cfg.delay;
+
+    switch (responder.cfg.dist) {
+        case DELAY_UNIFORM:
+            delay *= 2 * tinymt64_generate_double(&t->rand);
+            break;
+        case DELAY_EXPONENTIAL:
+            delay *= -log(1 - tinymt64_generate_double(&t->rand));
+            break;
+        case DELAY_FIXED:
+            break;
+    }
+
+    return (long long) (delay / 1000 + 0.5);
+}
+
+static int request_complete(http_parser *parser) {
+    responder_conn *c = parser->data;
+    long long delay = responder.cfg.delay ? responder_delay(c->thread) : 0;
+
+    if (delay > 0) {
+        aeCreateTimeEvent(c->thread->loop, delay, responder_delay_done, c, NULL);
+        c->delayed++;
+    } else {
+        c->ready++;
+    }
+    return 0;
+}
+
+static int responder_delay_done(aeEventLoop *loop, long long id, void *data) {
+    responder_conn *c = data;
+
+    c->delayed--;
+    if (c->closed) {
+        if (!c->delayed) zfree(c);
+        return AE_NOMORE;
+    }
+
+    c->ready++;
+    responder_flush(c);
+    return AE_NOMORE;
+}
+
+static void responder_readable(aeEventLoop *loop, int fd, void *data, int mask) {
+    responder_conn *c = data;
+    ssize_t n = read(fd, c->buf, sizeof(c->buf));
+
+    if (n < 0 && errno == EAGAIN) return;
+    if (n <= 0 || http_parser_execute(&c->parser, &parser_settings, c->buf, n) != (size_t) n) {
+        responder_close(c);
+        return;
+    }
+
+    responder_flush(c);
+}
+
+static void responder_writeable(aeEventLoop *loop, int fd, void *data, int mask) {
+    responder_flush(data);
+}
@@ -0,0 +1,24 @@
+#ifndef RESPONDER_H
+#define RESPONDER_H
+
+#include <stdint.h>
+
+// Distribution of the delay injected before each response.
+typedef enum {
+    DELAY_FIXED,
+    DELAY_UNIFORM,
+    DELAY_EXPONENTIAL,
+} delay_dist;
+
+typedef struct {
+    uint64_t threads;
+    uint64_t size;
+    uint64_t delay;
+    delay_dist dist;
+} responder_config;
+
+int responder_parse_dist(char *, delay_dist *);
+char *responder_dist_name(delay_dist);
+int responder_start(responder_config *, char *, char *);
+
+#endif /* RESPONDER_H */
@@ -2,10 +2,12 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/time.h>
 #include "script.h"
 #include "http_parser.h"
 #include "stats.h"
+#include "template.h"
 #include "zmalloc.h"
 #include "wrk.h"
 
@@ -24,6 +26,23 @@ static int script_thread_newindex(lua_State *);
 static int script_wrk_lookup(lua_State *);
 static int script_wrk_connect(lua_State *);
 static int script_wrk_time_us(lua_State *);
+static int script_wrk_compile(lua_State *);
+static int script_template_gc(lua_State *);
+static int script_headers_index(lua_State *);
+static int script_headers_call(lua_State *);
+static int script_body_index(lua_State *);
+static int script_body_len(lua_State *);
+static int script_body_tostring(lua_State *);
+static int script_body_concat(lua_State *);
+static void script_push_lazy(lua_State *, void *, const char *);
+static void *script_testudata(lua_State *, int, const char *);
+
+// Registry keys of the reusable response headers and body objects.
+static char headers_key;
+static char body_key;
+
+// Registry key of the table mapping request tags to ids and back.
+static char tags_key;
 
 static void set_fields(lua_State *, int, const table_field *);
 static void set_field(lua_State *, int, char *, int);
@@ -41,6 +60,24 @@ static const struct luaL_reg statslib[] = {
     { NULL,         NULL                   }
 };
 
+static const struct luaL_reg templatelib[] = {
+    { "__gc",       script_template_gc     },
+    { NULL,         NULL                   }
+};
+
+static const struct luaL_reg headerslib[] = {
+    { "__index",    script_headers_index   },
+    { "__call",     script_headers_call    },
+    { NULL,         NULL                   }
+};
+
+static const struct luaL_reg bodylib[] = {
+    { "__len",      script_body_len        },
+    { "__tostring", script_body_tostring   },
+    { "__concat",   script_body_concat     },
+    { NULL,         NULL                   }
+};
+
 static const struct luaL_reg threadlib[] = {
     { "__index",    script_thread_index    },
     { "__newindex", script_thread_newindex },
@@ -58,6 +95,15 @@ lua_State *script_create(char *file, char *url, char **headers) {
     luaL_register(L, NULL, statslib);
     luaL_newmetatable(L, "wrk.thread");
     luaL_register(L, NULL, threadlib);
+    luaL_newmetatable(L, "wrk.template");
+    luaL_register(L, NULL, templatelib);
+    luaL_newmetatable(L, "wrk.headers");
+    luaL_register(L, NULL, headerslib);
+    luaL_newmetatable(L, "wrk.body");
+    luaL_register(L, NULL, bodylib);
+    lua_newtable(L);
+    lua_pushcclosure(L, script_body_index, 1);
+    lua_setfield(L, -2, "__index");
 
     struct http_parser_url parts = {};
     script_parse_url(url, &parts);
@@ -71,27 +117,35 @@ lua_State *script_create(char *file, char *url, char **headers) {
         { "lookup",  LUA_TFUNCTION, script_wrk_lookup  },
         { "connect", LUA_TFUNCTION, script_wrk_connect },
         { "time_us", LUA_TFUNCTION, script_wrk_time_us },
+        { "compile", LUA_TFUNCTION, script_wrk_compile },
         { "path",    LUA_TSTRING,   path               },
         { NULL,      0,             NULL               },
     };
 
     lua_getglobal(L, "wrk");
 
-    set_field(L, 4, "scheme", push_url_part(L, url, &parts, UF_SCHEMA));
-    set_field(L, 4, "host",   push_url_part(L, url, &parts, UF_HOST));
-    set_field(L, 4, "port",   push_url_part(L, url, &parts, UF_PORT));
-    set_fields(L, 4, fields);
+    set_field(L, 7, "scheme", push_url_part(L, url, &parts, UF_SCHEMA));
+    set_field(L, 7, "host",   push_url_part(L, url, &parts, UF_HOST));
+    set_field(L, 7, "port",   push_url_part(L, url, &parts, UF_PORT));
+    set_fields(L, 7, fields);
 
-    lua_getfield(L, 4, "headers");
+    lua_getfield(L, 7, "headers");
     for (char **h = headers; *h; h++) {
         char *p = strchr(*h, ':');
         if (p && p[1] == ' ') {
             lua_pushlstring(L, *h, p - *h);
             lua_pushstring(L, p + 2);
-            lua_settable(L, 5);
+            lua_settable(L, 8);
         }
     }
-    lua_pop(L, 5);
+    lua_pop(L, 8);
+
+    script_push_lazy(L, &headers_key, "wrk.headers");
+    script_push_lazy(L, &body_key,    "wrk.body");
+
+    lua_pushlightuserdata(L, &tags_key);
+    lua_newtable(L);
+    lua_rawset(L, LUA_REGISTRYINDEX);
 
     if (file && luaL_dofile(L, file)) {
         const char *cause = lua_tostring(L, -1);
@@ -115,6 +169,26 @@ bool script_resolve(lua_State *L, char *host, char *service) {
     return count > 0;
 }
 
+// Create the userdata passed to response() as headers or body when the
+// script sets wrk.lazy_response. One object of each kind is created per
+// Lua state and re-pointed at the connection's buffers for every
+// response, so response() allocates nothing unless the script asks for a
+// header value or the body.
+static void script_push_lazy(lua_State *L, void *key, const char *name) {
+    lua_pushlightuserdata(L, key);
+    buffer **b = (buffer **) lua_newuserdata(L, sizeof(buffer **));
+    *b = NULL;
+    luaL_getmetatable(L, name);
+    lua_setmetatable(L, -2);
+    lua_rawset(L, LUA_REGISTRYINDEX);
+}
+
+static buffer **script_get_lazy(lua_State *L, void *key) {
+    lua_pushlightuserdata(L, key);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    return (buffer **) lua_touserdata(L, -1);
+}
+
 void script_push_thread(lua_State *L, thread *t) {
     thread **ptr = (thread **) lua_newuserdata(L, sizeof(thread **));
     *ptr = t;
@@ -144,34 +218,88 @@ void script_init(lua_State *L, thread *t, int argc, char **argv) {
     lua_pop(t->L, 1);
 }
 
-void script_request(lua_State *L, char **buf, size_t *len) {
-    int pop = 1;
+// Map the tag string at the top of the stack to a small integer id,
+// assigning the next free id the first time a tag is seen.
+static int script_tag_id(lua_State *L) {
+    lua_pushlightuserdata(L, &tags_key);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    lua_pushvalue(L, -2);
+    lua_rawget(L, -2);
+
+    if (lua_isnumber(L, -1)) {
+        int id = lua_tointeger(L, -1);
+        lua_pop(L, 2);
+        return id;
+    }
+
+    int id = lua_objlen(L, -2);
+    if (id >= MAX_TAGS) {
+        luaL_error(L, "too many request tags, at most %d are supported", MAX_TAGS);
+    }
+
+    lua_pop(L, 1);
+    lua_pushvalue(L, -2);
+    lua_pushinteger(L, id);
+    lua_rawset(L, -3);
+    lua_pushvalue(L, -2);
+    lua_rawseti(L, -2, id + 1);
+    lua_pop(L, 1);
+    return id;
+}
+
+const char *script_tag_name(lua_State *L, int id) {
+    lua_pushlightuserdata(L, &tags_key);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    lua_rawgeti(L, -1, id + 1);
+    const char *name = lua_tostring(L, -1);
+    lua_pop(L, 2);
+    return name;
+}
+
+int script_request(lua_State *L, char **buf, size_t *len) {
+    int pop = 2, tag = -1;
     lua_getglobal(L, "request");
     if (!lua_isfunction(L, -1)) {
         lua_getglobal(L, "wrk");
         lua_getfield(L, -1, "request");
         pop += 2;
     }
-    lua_call(L, 0, 1);
-    const char *str = lua_tolstring(L, -1, len);
+    lua_call(L, 0, 2);
+    const char *str = lua_tolstring(L, -2, len);
     *buf = realloc(*buf, *len);
     memcpy(*buf, str, *len);
+    if (lua_type(L, -1) == LUA_TSTRING) {
+        tag = script_tag_id(L);
+    }
     lua_pop(L, pop);
+    return tag;
 }
 
-void script_response(lua_State *L, int status, buffer *headers, buffer *body) {
+void script_response(lua_State *L, int status, buffer *headers, buffer *body, bool lazy) {
     lua_getglobal(L, "response");
     lua_pushinteger(L, status);
-    lua_newtable(L);
 
-    for (char *c = headers->buffer; c < headers->cursor; ) {
-        c = buffer_pushlstring(L, c);
-        c = buffer_pushlstring(L, c);
-        lua_rawset(L, -3);
-    }
+    if (!lazy) {
+        lua_newtable(L);
 
-    lua_pushlstring(L, body->buffer, body->cursor - body->buffer);
-    lua_call(L, 3, 0);
+        for (char *c = headers->buffer; c < headers->cursor; ) {
+            c = buffer_pushlstring(L, c);
+            c = buffer_pushlstring(L, c);
+            lua_rawset(L, -3);
+        }
+
+        lua_pushlstring(L, body->buffer, body->cursor - body->buffer);
+        lua_call(L, 3, 0);
+    } else {
+        buffer **h = script_get_lazy(L, &headers_key);
+        buffer **b = script_get_lazy(L, &body_key);
+
+        *h = headers;
+        *b = body;
+        lua_call(L, 3, 0);
+        *h = NULL;
+        *b = NULL;
+    }
 
     buffer_reset(headers);
     buffer_reset(body);
@@ -192,6 +320,32 @@ bool script_want_response(lua_State *L) {
     return script_is_function(L, "response");
 }
 
+bool script_lazy_response(lua_State *L) {
+    lua_getglobal(L, "wrk");
+    lua_getfield(L, -1, "lazy_response");
+    bool lazy = lua_toboolean(L, -1);
+    lua_pop(L, 2);
+    return lazy;
+}
+
+static void *script_testudata(lua_State *L, int index, const char *name) {
+    void *p = lua_touserdata(L, index);
+    if (p && lua_getmetatable(L, index)) {
+        luaL_getmetatable(L, name);
+        if (!lua_rawequal(L, -1, -2)) p = NULL;
+        lua_pop(L, 2);
+        return p;
+    }
+    return NULL;
+}
+
+template *script_template(lua_State *L) {
+    lua_getglobal(L, "request");
+    template **t = script_testudata(L, -1, "wrk.template");
+    lua_pop(L, 1);
+    return t ? *t : NULL;
+}
+
 bool script_has_done(lua_State *L) {
     return script_is_function(L, "done");
 }
@@ -217,7 +371,9 @@ void script_errors(lua_State *L, errors *errors) {
         errors->read,
         errors->write,
         errors->status,
-        errors->timeout
+        errors->timeout,
+        errors->range,
+        errors->unanswered
     };
     const table_field fields[] = {
         { "connect", LUA_TNUMBER, &e[0] },
@@ -225,6 +381,8 @@ void script_errors(lua_State *L, errors *errors) {
         { "write",   LUA_TNUMBER, &e[2] },
         { "status",  LUA_TNUMBER, &e[3] },
         { "timeout", LUA_TNUMBER, &e[4] },
+        { "range",   LUA_TNUMBER, &e[5] },
+        { "unanswered", LUA_TNUMBER, &e[6] },
         { NULL,      0,           NULL  },
     };
     lua_newtable(L);
@@ -232,6 +390,41 @@ void script_errors(lua_State *L, errors *errors) {
     lua_setfield(L, 1, "errors");
 }
 
+void script_statuses(lua_State *L, statuses *statuses) {
+    lua_newtable(L);
+    for (int i = 0; i <= STATUS_MAX - STATUS_MIN; i++) {
+        if (statuses->codes[i] == 0) continue;
+        lua_pushnumber(L, statuses->codes[i]);
+        lua_rawseti(L, -2, STATUS_MIN + i);
+    }
+    lua_setfield(L, 1, "statuses");
+}
+
+static void script_push_stats(lua_State *L, stats *latency) {
+    stats **s = (stats **) lua_newuserdata(L, sizeof(stats **));
+    *s = latency;
+    luaL_getmetatable(L, "wrk.stats");
+    lua_setmetatable(L, -2);
+}
+
+void script_latency(lua_State *L, char *name, stats *latency) {
+    script_push_stats(L, latency);
+    lua_setfield(L, 1, name);
+}
+
+void script_tags(lua_State *L, char **names, stats **latency, stats **u_latency, int count) {
+    lua_newtable(L);
+    for (int i = 0; i < count; i++) {
+        lua_newtable(L);
+        script_push_stats(L, latency[i]);
+        lua_setfield(L, -2, "latency");
+        script_push_stats(L, u_latency[i]);
+        lua_setfield(L, -2, "u_latency");
+        lua_setfield(L, -2, names[i]);
+    }
+    lua_setfield(L, 1, "tags");
+}
+
 void script_done(lua_State *L, stats *latency, stats *requests) {
     stats **s;
 
@@ -265,8 +458,18 @@ size_t script_verify_request(lua_State *L) {
     http_parser parser;
     char *request = NULL;
     size_t len, count = 0;
-
-    script_request(L, &request, &len);
+    template *t;
+
+    if ((t = script_template(L))) {
+        tinymt64_t rand;
+        uint64_t seq = t->seq;
+        tinymt64_init(&rand, 0);
+        request = realloc(request, t->max_length);
+        len = template_render(t, &rand, request);
+        t->seq = seq;
+    } else {
+        script_request(L, &request, &len);
+    }
     http_parser_init(&parser, HTTP_REQUEST);
     parser.data = &count;
 
@@ -483,6 +686,129 @@ static int script_wrk_time_us(lua_State *L) {
     return 1;
 }
 
+static int script_wrk_compile(lua_State *L) {
+    size_t len;
+    const char *src = luaL_checklstring(L, 1, &len);
+    const char *error = NULL;
+
+    template *t = template_compile(src, len, &error);
+    if (!t) return luaL_error(L, "%s", error);
+
+    template **ptr = (template **) lua_newuserdata(L, sizeof(template **));
+    *ptr = t;
+    luaL_getmetatable(L, "wrk.template");
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+static int script_template_gc(lua_State *L) {
+    template **t = luaL_checkudata(L, 1, "wrk.template");
+    template_free(*t);
+    return 0;
+}
+
+static buffer *checkbuffer(lua_State *L, const char *name) {
+    buffer **b = luaL_checkudata(L, 1, name);
+    if (*b == NULL) luaL_error(L, "response data used outside of response()");
+    return *b;
+}
+
+static int script_headers_index(lua_State *L) {
+    buffer *b = checkbuffer(L, "wrk.headers");
+    const char *name = luaL_checkstring(L, 2);
+
+    for (char *c = b->buffer; c < b->cursor; ) {
+        char *value = strchr(c, 0) + 1;
+        if (!strcasecmp(c, name)) {
+            buffer_pushlstring(L, value);
+            return 1;
+        }
+        c = strchr(value, 0) + 1;
+    }
+
+    lua_pushnil(L);
+    return 1;
+}
+
+static int script_headers_next(lua_State *L) {
+    buffer *b = checkbuffer(L, "wrk.headers");
+    size_t offset = lua_tointeger(L, lua_upvalueindex(1));
+    char *c = b->buffer + offset;
+
+    if (c >= b->cursor) return 0;
+
+    c = buffer_pushlstring(L, c);
+    c = buffer_pushlstring(L, c);
+    lua_pushinteger(L, c - b->buffer);
+    lua_replace(L, lua_upvalueindex(1));
+    return 2;
+}
+
+static int script_headers_call(lua_State *L) {
+    checkbuffer(L, "wrk.headers");
+    lua_pushinteger(L, 0);
+    lua_pushcclosure(L, script_headers_next, 1);
+    lua_pushvalue(L, 1);
+    return 2;
+}
+
+static void script_body_push(lua_State *L, int index) {
+    buffer *b = *(buffer **) lua_touserdata(L, index);
+    lua_pushlstring(L, b->buffer, b->cursor - b->buffer);
+}
+
+static int script_body_method(lua_State *L) {
+    checkbuffer(L, "wrk.body");
+    script_body_push(L, 1);
+    lua_replace(L, 1);
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_insert(L, 1);
+    lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+    return lua_gettop(L);
+}
+
+// Look up string methods for the body, wrapping each in a closure once
+// and caching it in the table that is the upvalue of __index.
+static int script_body_index(lua_State *L) {
+    checkbuffer(L, "wrk.body");
+    const char *name = luaL_checkstring(L, 2);
+
+    lua_getfield(L, lua_upvalueindex(1), name);
+    if (!lua_isnil(L, -1)) return 1;
+
+    lua_getglobal(L, "string");
+    lua_getfield(L, -1, name);
+    if (!lua_isfunction(L, -1)) return 1;
+    lua_pushcclosure(L, script_body_method, 1);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, lua_upvalueindex(1), name);
+    return 1;
+}
+
+static int script_body_len(lua_State *L) {
+    buffer *b = checkbuffer(L, "wrk.body");
+    lua_pushinteger(L, b->cursor - b->buffer);
+    return 1;
+}
+
+static int script_body_tostring(lua_State *L) {
+    checkbuffer(L, "wrk.body");
+    script_body_push(L, 1);
+    return 1;
+}
+
+static int script_body_concat(lua_State *L) {
+    for (int i = 1; i <= 2; i++) {
+        buffer **b = script_testudata(L, i, "wrk.body");
+        if (!b) continue;
+        if (*b == NULL) return luaL_error(L, "response data used outside of response()");
+        lua_pushlstring(L, (*b)->buffer, (*b)->cursor - (*b)->buffer);
+        lua_replace(L, i);
+    }
+    lua_concat(L, 2);
+    return 1;
+}
+
 void script_copy_value(lua_State *src, lua_State *dst, int index) {
     switch (lua_type(src, index)) {
         case LUA_TBOOLEAN:
@@ -563,13 +889,64 @@ static void set_fields(lua_State *L, int index, const table_field *fields) {
     }
 }
 
-void buffer_append(buffer *b, const char *data, size_t len) {
+static int buffer_class(size_t length) {
+    int class = 0;
+    while (((size_t) BUFFER_MIN << class) < length) class++;
+    return class;
+}
+
+static char *buffer_pool_get(buffer_pool *pool, size_t length) {
+    int class = buffer_class(length);
+    char *buf;
+
+    if (class < BUFFER_CLASSES && (buf = pool->free[class])) {
+        pool->free[class] = *(char **) buf;
+        pool->cached[class]--;
+        return buf;
+    }
+    return zmalloc(length);
+}
+
+static void buffer_pool_put(buffer_pool *pool, char *buf, size_t length) {
+    int class = buffer_class(length);
+
+    if (class >= BUFFER_CLASSES || pool->cached[class] == BUFFER_CACHED) {
+        zfree(buf);
+        return;
+    }
+    *(char **) buf = pool->free[class];
+    pool->free[class] = buf;
+    pool->cached[class]++;
+}
+
+// Grow b to more than size bytes. Pooled buffers double into the next
+// size class, so a large body is copied a logarithmic number of times.
+static void buffer_grow(buffer *b, size_t size) {
     size_t used = b->cursor - b->buffer;
-    while (used + len + 1 >= b->length) {
-        b->length += 1024;
-        b->buffer  = realloc(b->buffer, b->length);
-        b->cursor  = b->buffer + used;
+
+    if (!b->pool) {
+        while (size >= b->length) b->length += 1024;
+        b->buffer = realloc(b->buffer, b->length);
+        b->cursor = b->buffer + used;
+        return;
     }
+
+    size_t length = b->length ? b->length : BUFFER_MIN;
+    while (size >= length) length *= 2;
+
+    char *buf = buffer_pool_get(b->pool, length);
+    if (b->buffer) {
+        memcpy(buf, b->buffer, used);
+        buffer_pool_put(b->pool, b->buffer, b->length);
+    }
+    b->buffer = buf;
+    b->length = length;
+    b->cursor = buf + used;
+}
+
+void buffer_append(buffer *b, const char *data, size_t len) {
+    size_t used = b->cursor - b->buffer;
+    if (used + len + 1 >= b->length) buffer_grow(b, used + len + 1);
     memcpy(b->cursor, data, len);
     b->cursor += len;
 }
@@ -578,6 +955,30 @@ void buffer_reset(buffer *b) {
     b->cursor = b->buffer;
 }
 
+// Return a pooled buffer to its pool, so that memory is held by the
+// responses in flight rather than by every connection.
+void buffer_release(buffer *b) {
+    if (!b->pool) {
+        buffer_reset(b);
+        return;
+    }
+    if (b->buffer) buffer_pool_put(b->pool, b->buffer, b->length);
+    b->buffer = NULL;
+    b->cursor = NULL;
+    b->length = 0;
+}
+
+void buffer_pool_free(buffer_pool *pool) {
+    for (int i = 0; i < BUFFER_CLASSES; i++) {
+        while (pool->free[i]) {
+            char *buf = pool->free[i];
+            pool->free[i] = *(char **) buf;
+            zfree(buf);
+        }
+        pool->cached[i] = 0;
+    }
+}
+
 char *buffer_pushlstring(lua_State *L, char *start) {
     char *end = strchr(start, 0);
     lua_pushlstring(L, start, end - start);
@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include "stats.h"
 #include "wrk.h"
+#include "template.h"
 
 lua_State *script_create(char *, char *, char **);
 
@@ -16,21 +17,29 @@ void script_setup(lua_State *, thread *);
 void script_done(lua_State *, stats *, stats *);
 
 void script_init(lua_State *, thread *, int, char **);
-void script_request(lua_State *, char **, size_t *);
-void script_response(lua_State *, int, buffer *, buffer *);
+int script_request(lua_State *, char **, size_t *);
+const char *script_tag_name(lua_State *, int);
+void script_response(lua_State *, int, buffer *, buffer *, bool);
 size_t script_verify_request(lua_State *L);
 
 bool script_is_static(lua_State *);
 bool script_want_response(lua_State *L);
+bool script_lazy_response(lua_State *L);
 bool script_has_done(lua_State *L);
+template *script_template(lua_State *);
 void script_summary(lua_State *, uint64_t, uint64_t, uint64_t);
 void script_errors(lua_State *, errors *);
+void script_statuses(lua_State *, statuses *);
+void script_latency(lua_State *, char *, stats *);
+void script_tags(lua_State *, char **, stats **, stats **, int);
 
 void script_copy_value(lua_State *, lua_State *, int);
 int script_parse_url(char *, struct http_parser_url *);
 
 void buffer_append(buffer *, const char *, size_t);
 void buffer_reset(buffer *);
+void buffer_release(buffer *);
+void buffer_pool_free(buffer_pool *);
 char *buffer_pushlstring(lua_State *, char *);
 
 #endif /* SCRIPT_H */
@@ -44,6 +44,43 @@ void stats_record(stats *stats, uint64_t x) {
     if (stats->index == stats->samples) stats->index = 0;
 }
 
+void stats_record_status(statuses *s, int status) {
+    if (status < STATUS_MIN || status > STATUS_MAX) {
+        s->other++;
+        return;
+    }
+    s->codes[status - STATUS_MIN]++;
+}
+
+void stats_merge_errors(errors *dst, errors *src) {
+    dst->connect     += src->connect;
+    dst->read        += src->read;
+    dst->write       += src->write;
+    dst->status      += src->status;
+    dst->timeout     += src->timeout;
+    dst->established += src->established;
+    dst->reconnect   += src->reconnect;
+    dst->range       += src->range;
+    dst->unanswered  += src->unanswered;
+}
+
+void stats_merge_statuses(statuses *dst, statuses *src) {
+    dst->other += src->other;
+    for (int i = 0; i <= STATUS_MAX - STATUS_MIN; i++) {
+        dst->codes[i] += src->codes[i];
+    }
+}
+
+// Total responses with a status code in [class * 100, class * 100 + 99].
+uint64_t stats_status_class(statuses *s, int class) {
+    uint64_t total = 0;
+    int start = class * 100 - STATUS_MIN;
+    for (int i = MAX(start, 0); i < start + 100 && i <= STATUS_MAX - STATUS_MIN; i++) {
+        total += s->codes[i];
+    }
+    return total;
+}
+
 static int stats_compare(const void *a, const void *b) {
     uint64_t *x = (uint64_t *) a;
     uint64_t *y = (uint64_t *) b;
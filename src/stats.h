@@ -17,8 +17,18 @@ typedef struct {
     uint32_t timeout;
     uint32_t established;
     uint32_t reconnect;
+    uint32_t range;
+    uint32_t unanswered;
 } errors;
 
+#define STATUS_MIN 100
+#define STATUS_MAX 599
+
+typedef struct {
+    uint64_t other;
+    uint64_t codes[STATUS_MAX - STATUS_MIN + 1];
+} statuses;
+
 typedef struct {
     uint64_t samples;
     uint64_t index;
@@ -35,6 +45,10 @@ void stats_reset(stats *);
 void stats_rewind(stats *);
 
 void stats_record(stats *, uint64_t);
+void stats_record_status(statuses *, int);
+void stats_merge_errors(errors *, errors *);
+void stats_merge_statuses(statuses *, statuses *);
+uint64_t stats_status_class(statuses *, int);
 
 long double stats_summarize(stats *);
 long double stats_mean(stats *);
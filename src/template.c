@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "template.h"
+#include "stats.h"
+#include "zmalloc.h"
+
+// Maximum number of decimal digits in a uint64_t.
+#define TEMPLATE_DIGITS 20
+
+static int scan_uint(const char **s, const char *end, uint64_t *n) {
+    const char *p = *s;
+    uint64_t v = 0;
+
+    if (p == end || *p < '0' || *p > '9') return -1;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        uint64_t d = *p - '0';
+        if (v > (UINT64_MAX - d) / 10) return -1;
+        v = v * 10 + d;
+    }
+
+    *s = p;
+    *n = v;
+    return 0;
+}
+
+static int scan_field(const char *s, const char *end, template_op *op) {
+    size_t len = end - s;
+
+    if (len >= 3 && !strncmp(s, "seq", 3)) {
+        op->type = TEMPLATE_SEQ;
+        op->min  = 0;
+        s += 3;
+        if (s == end) return 0;
+        if (*s++ != ':' || scan_uint(&s, end, &op->min)) return -1;
+        return s == end ? 0 : -1;
+    }
+
+    if (len >= 4 && !strncmp(s, "rand", 4)) {
+        op->type = TEMPLATE_RAND;
+        s += 4;
+        if (s == end || *s++ != ':' || scan_uint(&s, end, &op->min)) return -1;
+        if (s == end || *s++ != ':' || scan_uint(&s, end, &op->max)) return -1;
+        if (s != end || op->max < op->min) return -1;
+        if (op->max - op->min == UINT64_MAX) return -1;
+        return 0;
+    }
+
+    return -1;
+}
+
+// Compile a formatted request containing {seq}, {seq:START} and
+// {rand:MIN:MAX} placeholders into literal chunks and substitution
+// ops. Only the request line and headers are scanned, so bodies with
+// braces (JSON, etc.) are passed through untouched. "{{" is a literal
+// '{'. Returns NULL and sets *error if the template is invalid.
+template *template_compile(const char *src, size_t len, const char **error) {
+    const char *end = src + len;
+    const char *head_end = end;
+    size_t nops = 1;
+
+    for (const char *p = src; p + 4 <= end; p++) {
+        if (!memcmp(p, "\r\n\r\n", 4)) {
+            head_end = p + 4;
+            break;
+        }
+    }
+
+    for (const char *p = src; p < head_end; p++) {
+        if (*p == '{') nops += 2;
+    }
+
+    template *t = zcalloc(sizeof(template) + nops * sizeof(template_op));
+    t->text = zmalloc(len + 1);
+
+    template_op *op = NULL;
+    size_t used = 0;
+    const char *p = src;
+
+    while (p < end) {
+        if (p < head_end && *p == '{' && !(p + 1 < head_end && p[1] == '{')) {
+            const char *close = memchr(p, '}', head_end - p);
+            if (!close) {
+                *error = "unterminated template field";
+                goto error;
+            }
+            op = &t->ops[t->count++];
+            if (scan_field(p + 1, close, op)) {
+                *error = "invalid template field, expected {seq}, {seq:N} or {rand:MIN:MAX}";
+                goto error;
+            }
+            t->max_length += TEMPLATE_DIGITS;
+            p  = close + 1;
+            op = NULL;
+            continue;
+        }
+
+        if (!op) {
+            op = &t->ops[t->count++];
+            op->type   = TEMPLATE_LITERAL;
+            op->offset = used;
+        }
+
+        t->text[used++] = *p;
+        op->length++;
+        t->max_length++;
+        p += (p < head_end && *p == '{') ? 2 : 1;
+    }
+
+    return t;
+
+  error:
+    template_free(t);
+    return NULL;
+}
+
+void template_free(template *t) {
+    if (!t) return;
+    zfree(t->text);
+    zfree(t);
+}
+
+static size_t format_uint(char *dst, uint64_t n) {
+    char tmp[TEMPLATE_DIGITS];
+    size_t len = 0;
+
+    do {
+        tmp[len++] = '0' + (n % 10);
+        n /= 10;
+    } while (n);
+
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = tmp[len - i - 1];
+    }
+    return len;
+}
+
+// Render the next request into buf, which must hold at least
+// t->max_length bytes. Returns the number of bytes written.
+size_t template_render(template *t, tinymt64_t *rand, char *buf) {
+    char *c = buf;
+
+    for (size_t i = 0; i < t->count; i++) {
+        template_op *op = &t->ops[i];
+        switch (op->type) {
+            case TEMPLATE_LITERAL:
+                memcpy(c, t->text + op->offset, op->length);
+                c += op->length;
+                break;
+            case TEMPLATE_SEQ:
+                c += format_uint(c, op->min + t->seq);
+                break;
+            case TEMPLATE_RAND:
+                c += format_uint(c, op->min + rand64(rand, op->max - op->min + 1));
+                break;
+        }
+    }
+
+    t->seq++;
+    return c - buf;
+}
@@ -0,0 +1,34 @@
+#ifndef TEMPLATE_H
+#define TEMPLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "tinymt64.h"
+
+typedef enum {
+    TEMPLATE_LITERAL,
+    TEMPLATE_SEQ,
+    TEMPLATE_RAND
+} template_op_type;
+
+typedef struct {
+    template_op_type type;
+    size_t offset;
+    size_t length;
+    uint64_t min;
+    uint64_t max;
+} template_op;
+
+typedef struct template {
+    char *text;
+    size_t max_length;
+    uint64_t seq;
+    size_t count;
+    template_op ops[];
+} template;
+
+template *template_compile(const char *, size_t, const char **);
+void template_free(template *);
+size_t template_render(template *, tinymt64_t *, char *);
+
+#endif /* TEMPLATE_H */
@@ -8,5 +8,6 @@ char *format_time_s(long double);
 
 int scan_metric(char *, uint64_t *);
 int scan_time(char *, uint64_t *);
+int scan_time_us(char *, uint64_t *);
 
 #endif /* UNITS_H */
@@ -9,6 +9,7 @@
 #include "script.h"
 #include "main.h"
 #include "hdr_histogram.h"
+#include "hdr_histogram_log.h"
 #include "stats.h"
 
 // Max recordable latency of 1 day
@@ -18,6 +19,52 @@
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
 #endif
 
+// Values for long options without a short equivalent
+enum {
+    OPT_RESPONSE_SAMPLE = 256,
+    OPT_RESPONSE_RATE,
+    OPT_RESPONSE_ERRORS,
+    OPT_PROCESSES,
+    OPT_WORKERS,
+    OPT_SERVE,
+    OPT_HDR_LOG,
+    OPT_HDR_DIGITS,
+    OPT_HDR_MAX,
+    OPT_HDR_AUTO,
+    OPT_HDR_INTERVAL,
+    OPT_SELF_TEST,
+    OPT_RESPONDER_SIZE,
+    OPT_RESPONDER_DELAY,
+    OPT_RESPONDER_DIST,
+    OPT_STEADY,
+    OPT_WARMUP_DURATION,
+    OPT_WARMUP_REQUESTS,
+    OPT_WARMUP_RATE,
+    OPT_DRAIN,
+    OPT_CATCH_UP,
+    OPT_CONTROL,
+    OPT_MAX_CONNECTIONS,
+    OPT_METRICS,
+    OPT_TIMESTAMPS,
+    OPT_TCP_INFO,
+    OPT_SPIN,
+    OPT_BUSY_POLL,
+    OPT_HUGE_PAGES,
+    OPT_LUA_GC,
+};
+
+enum {
+    CATCH_UP_BURST = 0,
+    CATCH_UP_UNLIMITED,
+    CATCH_UP_DROP,
+};
+
+enum {
+    TIMESTAMPS_OFF = 0,
+    TIMESTAMPS_SOFTWARE,
+    TIMESTAMPS_HARDWARE,
+};
+
 enum {
     PHASE_INIT = 0,
     PHASE_WARMUP,
@@ -33,15 +80,49 @@ static struct config {
     uint64_t rate;
     uint64_t delay_ms;
     uint64_t warmup_timeout;
+    uint64_t response_rate;
+    uint64_t processes;
+    uint64_t hdr_digits;
+    uint64_t hdr_max;
+    uint64_t hdr_interval;
+    uint64_t interval;
+    uint64_t warmup_duration;
+    uint64_t warmup_requests;
+    uint64_t warmup_rate[2];
+    uint64_t drain;
+    uint64_t max_connections;
+    uint64_t tcp_info;
+    uint64_t busy_poll;
+    uint64_t lua_gc;
+    int64_t  spin;
+    double   response_sample;
+    double   steady;
+    double   catch_up_factor;
+    int      catch_up;
+    int      timestamps;
+    int      huge_pages;
+    bool     response_errors;
     bool     latency;
     bool     u_latency;
     bool     dynamic;
+    bool     response;
+    bool     lazy_response;
     bool     record_all_responses;
     bool     warmup;
+    bool     coordinated;
+    bool     hdr_auto;
+    bool     self_test;
+    int      control;
+    char    *workers;
+    char    *serve;
+    char    *hdr_log;
+    char    *control_socket;
+    char    *metrics;
     char    *host;
     char    *script;
     char    *local_ip;
     SSL_CTX *ctx;
+    responder_config responder;
 } cfg;
 
 static struct {
@@ -49,6 +130,22 @@ static struct {
     pthread_mutex_t mutex;
 } statistics;
 
+static struct {
+    FILE *file;
+    uint64_t start;
+} histogram_log;
+
+static command_server commands = { .fd = -1 };
+
+static struct {
+    pthread_mutex_t mutex;
+    double interval_s;
+    uint64_t count;
+    double quantiles[METRICS_QUANTILES];
+} interval_latency = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+static double metrics_quantiles[METRICS_QUANTILES] = { 50.0, 90.0, 99.0, 99.9, 100.0 };
+
 static struct sock sock = {
     .connect  = sock_connect,
     .close    = sock_close,
@@ -67,6 +164,7 @@ static volatile sig_atomic_t stop = 0;
 char *g_local_ip = NULL;
 
 int g_ready_threads = 0;
+int g_finished_threads = 0;
 static volatile sig_atomic_t g_is_ready = 0;
 
 static void handler(int sig) {
@@ -87,6 +185,30 @@ static void usage() {
            "    -L  --latency          Print latency statistics   \n"
            "    -U  --u_latency        Print uncorrected latency statistics\n"
            "        --timeout     <T>  Socket/request timeout     \n"
+           "        --catch_up    <S>  When behind schedule send  \n"
+           "                           at up to K times the rate  \n"
+           "                           (burst:K, default burst:2),\n"
+           "                           at once (unlimited) or skip\n"
+           "                           the missed requests (drop) \n"
+           "        --drain       <T>  Wait up to T for requests  \n"
+           "                           in flight at the end       \n"
+           "        --timestamps  <S>  Also measure wire latency  \n"
+           "                           with kernel timestamps     \n"
+           "                           (software or hardware, the \n"
+           "                           NIC must already stamp)    \n"
+           "        --tcp_info    <N>  Sample RTT, cwnd and       \n"
+           "                           retransmits of N connections\n"
+           "                           per thread every 100ms     \n"
+           "        --spin    <T|always>  Poll without sleeping for\n"
+           "                           up to T before blocking, or\n"
+           "                           always, for low jitter     \n"
+           "        --busy_poll   <T>  Busy poll sockets for T    \n"
+           "                           (SO_BUSY_POLL)             \n"
+           "        --huge_pages  <S>  Back connections and       \n"
+           "                           histograms with huge pages \n"
+           "                           (transparent or explicit)  \n"
+           "        --lua_gc      <T>  Collect Lua garbage while  \n"
+           "                           idle, up to T at a time    \n"
            "    -B, --batch_latency    Measure latency of whole   \n"
            "                           batches of pipelined ops   \n"
            "                           (as opposed to each op)    \n"
@@ -98,11 +220,101 @@ static void usage() {
            "                           In warmup phase connections are establised,\n"
            "                           but no requests are sent   \n"
            "                                                      \n"
+           "        --response_sample <F>  Call response() for a  \n"
+           "                           fraction F of responses    \n"
+           "        --response_rate   <N>  Call response() at most\n"
+           "                           N times/sec per thread     \n"
+           "        --response_errors  Always call response() for \n"
+           "                           non-2xx responses          \n"
+           "                                                      \n"
+           "        --processes <N>    Split the load between N   \n"
+           "                           local worker processes     \n"
+           "        --workers   <S>    Split the load between remote\n"
+           "                           workers (host:port,...)    \n"
+           "        --serve     <S>    Run as a remote worker on  \n"
+           "                           [addr:]port (default addr  \n"
+           "                           127.0.0.1), for coordinators\n"
+           "                           that know WRK_SECRET       \n"
+           "        --hdr_log   <F>    Write histograms to a HdrHistogram\n"
+           "                           log file                   \n"
+           "        --hdr_digits <N>   Latency significant figures, 1-5\n"
+           "                           (default 3)                \n"
+           "        --hdr_max   <T>    Highest recordable latency \n"
+           "                           (default 24h)              \n"
+           "        --hdr_auto         Grow histograms to record  \n"
+           "                           latencies above --hdr_max  \n"
+           "        --hdr_interval <T> Also log latency histograms \n"
+           "                           of each interval to --hdr_log\n"
+           "                                                      \n"
+           "        --warmup_duration <T>  Send warmup traffic for T\n"
+           "        --warmup_requests <N>  or N requests, reported \n"
+           "                           separately from the results\n"
+           "        --warmup_rate <N[:N]>  Warmup rate, ramped from\n"
+           "                           the first to the second N  \n"
+           "                           (default --rate)           \n"
+           "                                                      \n"
+           "        --steady    <F>    Measure once throughput and\n"
+           "                           p90 latency vary less than \n"
+           "                           F (e.g. 0.1), instead of   \n"
+           "                           after 10s of calibration   \n"
+           "                                                      \n"
+           "        --control   <F>    Accept commands on a Unix  \n"
+           "                           socket while running       \n"
+           "        --max_connections <N>  Connections the control \n"
+           "                           socket may grow to         \n"
+           "        --metrics   <S>    Serve OpenMetrics on       \n"
+           "                           [addr:]port (localhost)    \n"
+           "                                                      \n"
+           "        --self_test        Run against a built-in     \n"
+           "                           loopback responder, URL is \n"
+           "                           optional                   \n"
+           "        --responder_size  <N>  Response body size     \n"
+           "                           (default 128)              \n"
+           "        --responder_delay <T>  Mean response delay,   \n"
+           "                           in milliseconds (1ms)      \n"
+           "        --responder_dist  <S>  Delay distribution:    \n"
+           "                           fixed, uniform or exponential\n"
+           "                                                      \n"
            "                                                      \n"
            "  Numeric arguments may include a SI unit (1k, 1M, 1G)\n"
            "  Time arguments may include a time unit (2s, 2m, 2h)\n");
 }
 
+// Parse a catch-up policy: burst[:K], unlimited or drop.
+static int scan_catch_up(char *s) {
+    char *end;
+
+    if (!strcmp(s, "unlimited")) {
+        cfg.catch_up = CATCH_UP_UNLIMITED;
+    } else if (!strcmp(s, "drop")) {
+        cfg.catch_up = CATCH_UP_DROP;
+    } else if (!strncmp(s, "burst", 5) && (!s[5] || s[5] == ':')) {
+        cfg.catch_up = CATCH_UP_BURST;
+        if (s[5]) {
+            cfg.catch_up_factor = strtod(s + 6, &end);
+            if (*end || cfg.catch_up_factor < 1) return -1;
+        }
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// Parse a rate, or a start:end range of rates.
+static int scan_rate_range(char *s, uint64_t *rate) {
+    char *colon = strchr(s, ':');
+    char start[64];
+
+    if (!colon) {
+        if (scan_metric(s, &rate[0])) return -1;
+        rate[1] = rate[0];
+        return 0;
+    }
+
+    snprintf(start, sizeof(start), "%.*s", (int) (colon - s), s);
+    return scan_metric(start, &rate[0]) || scan_metric(colon + 1, &rate[1]) ? -1 : 0;
+}
+
 static size_t csv_nr(const char *s) {
     const char *p = s;
     size_t nr = 0;
@@ -126,12 +338,95 @@ int main(int argc, char **argv) {
         exit(1);
     }
 
-    char *schema  = copy_url_part(url, &parts, UF_SCHEMA);
-    char *host    = copy_url_part(url, &parts, UF_HOST);
-    char *port    = copy_url_part(url, &parts, UF_PORT);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (cfg.serve) {
+        coordinator_serve(cfg.serve, worker_main);
+        return 0;
+    }
+
+    if (cfg.self_test) url = self_test_start(&parts);
+
+    if (cfg.hdr_log) open_hdr_log(cfg.hdr_log);
+
+    if (cfg.control_socket && command_listen(&commands, cfg.control_socket)) {
+        fprintf(stderr, "unable to listen on %s: %s\n", cfg.control_socket, strerror(errno));
+        exit(1);
+    }
+
+    if (cfg.processes || cfg.workers) {
+        coordinate(url, headers, argc, argv);
+        return 0;
+    }
+
+    results results;
+    lua_State *L = benchmark(url, &parts, headers, argc, argv, &results);
+    report(L, &results);
+
+    if (cfg.self_test) self_test_report(&results);
+    if (cfg.control_socket) command_close(&commands);
+
+    return 0;
+}
+
+// Start the loopback responder with one thread per wrk thread and
+// return the URL to benchmark. Any URL given is ignored.
+static char *self_test_start(struct http_parser_url *parts) {
+    char *url = NULL;
+
+    cfg.responder.threads = cfg.threads;
+    int port = responder_start(&cfg.responder, "127.0.0.1", "0");
+    if (port < 0) {
+        fprintf(stderr, "unable to start responder: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    aprintf(&url, "http://127.0.0.1:%d/", port);
+    memset(parts, 0, sizeof(*parts));
+    script_parse_url(url, parts);
+    return url;
+}
+
+// The uncorrected latency against a responder that does not delay is
+// the floor latency added by wrk, the kernel and the loopback device.
+static void self_test_report(results *results) {
+    struct hdr_histogram *h = results->u_latency_histogram;
+    long double req_per_s = results->complete / (results->runtime_us / 1000000.0);
+    responder_config *r = &cfg.responder;
+
+    printf("Self test: %"PRIu64" responder threads, %sB responses", r->threads, format_binary(r->size));
+    if (r->delay) {
+        printf(", %s %s delay", responder_dist_name(r->dist), format_time_us(r->delay));
+    }
+    printf("\n");
+
+    printf("  Floor latency (uncorrected): min %s, 50%% %s, 99%% %s, 99.9%% %s, max %s\n",
+           format_time_us(hdr_min(h)),
+           format_time_us(hdr_value_at_percentile(h, 50.0)),
+           format_time_us(hdr_value_at_percentile(h, 99.0)),
+           format_time_us(hdr_value_at_percentile(h, 99.9)),
+           format_time_us(hdr_max(h)));
+    printf("  Requests/sec per thread: %9.2Lf\n", req_per_s / cfg.threads);
+    if (req_per_s < cfg.rate * 0.95) {
+        printf("  Rate of %"PRIu64" requests/sec not reached, the generator or\n"
+               "  responder is saturated\n", cfg.rate);
+    }
+}
+
+// Run the benchmark in this process and collect the merged results of
+// all threads. Returns the Lua state used to report them.
+static lua_State *benchmark(char *url, struct http_parser_url *parts, char **headers,
+                            int argc, char **argv, results *results) {
+    char *schema  = copy_url_part(url, parts, UF_SCHEMA);
+    char *host    = copy_url_part(url, parts, UF_HOST);
+    char *port    = copy_url_part(url, parts, UF_PORT);
     char *service = port ? port : schema;
 
     if (!strncmp("https", schema, 5)) {
+        if (cfg.timestamps) {
+            fprintf(stderr, "--timestamps is not supported with https\n");
+            exit(1);
+        }
         if ((cfg.ctx = ssl_init()) == NULL) {
             fprintf(stderr, "unable to initialize SSL\n");
             ERR_print_errors_fp(stderr);
@@ -143,6 +438,13 @@ int main(int argc, char **argv) {
         sock.write    = ssl_write;
         sock.readable = ssl_readable;
     }
+
+#ifdef SO_TIMESTAMPING
+    if (cfg.timestamps) {
+        sock_timestamps_init(cfg.timestamps == TIMESTAMPS_HARDWARE);
+        sock.read = sock_read_timestamped;
+    }
+#endif
 	
     cfg.host = host;
 
@@ -169,8 +471,6 @@ int main(int argc, char **argv) {
             g_local_ip = local_ip_arr[0];
     }
 
-    signal(SIGPIPE, SIG_IGN);
-
     pthread_mutex_init(&statistics.mutex, NULL);
     statistics.requests = stats_alloc(10);
     thread *threads = zcalloc(cfg.threads * sizeof(thread));
@@ -189,24 +489,34 @@ int main(int argc, char **argv) {
     double throughput    = (double)cfg.rate / cfg.threads;
     uint64_t stop_at     = time_us() + (cfg.duration * 1000000);
 
+    // Coordinated runs only start the clock once every worker is ready.
+    if (cfg.coordinated) stop_at = UINT64_MAX;
+
     for (uint64_t i = 0; i < cfg.threads; i++) {
         thread *t = &threads[i];
-        // TODO Review whether we can reduce number of events per thread
-        t->loop        = aeCreateEventLoop(10 + cfg.connections * 3);
         t->connections = connections;
+        t->max_connections = cfg.max_connections / cfg.threads;
+        t->loop        = aeCreateEventLoop(10 + t->max_connections);
         t->throughput = throughput;
         t->stop_at     = stop_at;
 
         if (local_ip_nr > 0)
             t->local_ip = local_ip_arr[i % local_ip_nr];
 
+        if (cfg.interval && hdr_recorder_init(&t->recorder, 1, cfg.hdr_max, cfg.hdr_digits)) {
+            fprintf(stderr, "unable to allocate interval histograms\n");
+            exit(1);
+        }
+
         t->L = script_create(cfg.script, url, headers);
         script_init(L, t, argc - optind, &argv[optind]);
 
         if (i == 0) {
             cfg.pipeline = script_verify_request(t->L);
             cfg.dynamic = !script_is_static(t->L);
-            if (script_want_response(t->L)) {
+            cfg.response = script_want_response(t->L);
+            cfg.lazy_response = script_lazy_response(t->L);
+            if (cfg.response) {
                 parser_settings.on_header_field = header_field;
                 parser_settings.on_header_value = header_value;
                 parser_settings.on_body         = response_body;
@@ -220,116 +530,760 @@ int main(int argc, char **argv) {
         }
     }
 
-    struct sigaction sa = {
-        .sa_handler = handler,
-        .sa_flags   = 0,
-    };
-    sigfillset(&sa.sa_mask);
-    sigaction(SIGINT, &sa, NULL);
+    if (cfg.coordinated) {
+        worker_run();
+    } else {
+        struct sigaction sa = {
+            .sa_handler = handler,
+            .sa_flags   = 0,
+        };
+        sigfillset(&sa.sa_mask);
+        sigaction(SIGINT, &sa, NULL);
+
+        if (cfg.metrics && metrics_start(cfg.metrics, metrics_text, threads)) {
+            fprintf(stderr, "unable to serve metrics on %s: %s\n", cfg.metrics, strerror(errno));
+            exit(1);
+        }
 
-    char *time = format_time_s(cfg.duration);
-    printf("Running %s test @ %s\n", time, url);
-    printf("  %"PRIu64" threads and %"PRIu64" connections\n",
-            cfg.threads, cfg.connections);
+        char *time = format_time_s(cfg.duration);
+        printf("Running %s test @ %s\n", time, url);
+        printf("  %"PRIu64" threads and %"PRIu64" connections\n",
+                cfg.threads, cfg.connections);
+    }
 
-    uint64_t start    = time_us();
-    uint64_t complete = 0;
-    uint64_t bytes    = 0;
-    errors errors     = { 0 };
+    uint64_t start = time_us();
+    long double rate = 0;
+
+    if ((cfg.interval || cfg.control_socket) && !cfg.coordinated) supervise(threads);
 
-    struct hdr_histogram* latency_histogram;
-    hdr_init(1, MAX_LATENCY, 3, &latency_histogram);
-    struct hdr_histogram* u_latency_histogram;
-    hdr_init(1, MAX_LATENCY, 3, &u_latency_histogram);
+    for (uint64_t i = 0; i < cfg.threads; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
 
-    uint64_t phase_normal_start_min = 0;
+    uint64_t stop = time_us();
+    results_init(results);
 
     for (uint64_t i = 0; i < cfg.threads; i++) {
         thread *t = &threads[i];
-        pthread_join(t->thread, NULL);
-        // Find timestamp of the first transition to the NORMAL phase.
-        // With WARMUP period enabled we use it to measure real benchmarking runtime.
-        if (!phase_normal_start_min || (t->phase_normal_start && t->phase_normal_start < phase_normal_start_min)) {
-            phase_normal_start_min = t->phase_normal_start;
+        // Each thread measures from its own transition to the NORMAL
+        // phase, after warmup and steady state which end at different
+        // times, so add up the throughput of each over its own time.
+        uint64_t measured = stop - (t->phase_normal_start ? t->phase_normal_start : start);
+        if (measured) rate += t->complete / (long double) measured;
+
+        results->complete += t->complete;
+        results->bytes    += t->bytes;
+
+        stats_merge_errors(&results->errors, &t->errors);
+        stats_merge_statuses(&results->statuses, &t->statuses);
+
+        hdr_add_grow(&results->latency_histogram, t->latency_histogram);
+        hdr_add_grow(&results->u_latency_histogram, t->u_latency_histogram);
+        hdr_add_grow(&results->success_histogram, t->success_histogram);
+        hdr_add_grow(&results->error_histogram, t->error_histogram);
+
+        results->warmup_runtime_us = MAX(results->warmup_runtime_us, t->warmup_runtime);
+        results->warmup_complete  += t->warmup_complete;
+        results->catch_up += t->catch_up;
+        results->dropped  += t->dropped;
+        hdr_add_grow(&results->warmup_histogram, t->warmup_histogram);
+        hdr_add_grow(&results->wire_histogram, t->wire_histogram);
+        tcp_stats_merge(&results->tcp, &t->tcp);
+        gc_stats_merge(&results->gc, &t->gc);
+
+        for (int j = 0; j < t->ntags; j++) {
+            tag_merge(results->tags, &results->ntags, &t->tags[j]);
         }
     }
 
-    if (phase_normal_start_min != 0) {
-        // Measure runtime starting from the first transition to NORMAL phase.
-        start = phase_normal_start_min;
-    }
-    uint64_t runtime_us = time_us() - start;
+    hdr_add_grow(&results->requests_histogram, statistics.requests->histogram);
+
+    // Report the runtime over which all requests give that throughput.
+    results->runtime_us = rate > 0 ? results->complete / rate : stop - start;
 
     for (uint64_t i = 0; i < cfg.threads; i++) {
         thread *t = &threads[i];
-        complete += t->complete;
-        bytes    += t->bytes;
-
-        errors.connect += t->errors.connect;
-        errors.read    += t->errors.read;
-        errors.write   += t->errors.write;
-        errors.timeout += t->errors.timeout;
-        errors.status  += t->errors.status;
-        errors.established += t->errors.established;
-        errors.reconnect += t->errors.reconnect;
-
-        hdr_add(latency_histogram, t->latency_histogram);
-        hdr_add(u_latency_histogram, t->u_latency_histogram);
+        if (cfg.huge_pages == HUGE_PAGES_EXPLICIT && t->arena.hugetlb < t->arena.mapped) {
+            fprintf(stderr, "warning: %.1fMB of thread %"PRIu64" not on explicit huge pages, "
+                    "see /proc/sys/vm/nr_hugepages\n",
+                    (t->arena.mapped - t->arena.hugetlb) / 1048576.0, i);
+        }
+        arena_free(&t->arena);
     }
 
-    long double runtime_s   = runtime_us / 1000000.0;
-    long double req_per_s   = complete   / runtime_s;
-    long double bytes_per_s = bytes      / runtime_s;
+    free(local_ip_tokens);
+    free(local_ip_arr);
+
+    return L;
+}
 
-    stats *latency_stats = stats_alloc(10);
-    latency_stats->min = hdr_min(latency_histogram);
-    latency_stats->max = hdr_max(latency_histogram);
-    latency_stats->histogram = latency_histogram;
+static void report(lua_State *L, results *results) {
+    long double runtime_s   = results->runtime_us / 1000000.0;
+    long double req_per_s   = results->complete   / runtime_s;
+    long double bytes_per_s = results->bytes      / runtime_s;
+    errors *errors          = &results->errors;
+
+    stats *latency_stats  = histogram_stats(results->latency_histogram);
+    stats *requests_stats = histogram_stats(results->requests_histogram);
+
+    if (results->warmup_complete) {
+        struct hdr_histogram *h = results->warmup_histogram;
+        printf("  Warmup: %"PRIu64" requests in %s, latency 50%% %s, 99%% %s, max %s (excluded)\n",
+               results->warmup_complete, format_time_us(results->warmup_runtime_us),
+               format_time_us(hdr_value_at_percentile(h, 50.0)),
+               format_time_us(hdr_value_at_percentile(h, 99.0)),
+               format_time_us(hdr_max(h)));
+    }
 
     print_stats_header();
     print_stats("Latency", latency_stats, format_time_us);
-    print_stats("Req/Sec", statistics.requests, format_metric);
+    print_stats("Req/Sec", requests_stats, format_metric);
 
     if (cfg.latency) {
-        print_hdr_latency(latency_histogram,
+        print_hdr_latency(results->latency_histogram,
                 "Recorded Latency");
         printf("----------------------------------------------------------\n");
     }
 
     if (cfg.u_latency) {
         printf("\n");
-        print_hdr_latency(u_latency_histogram,
+        print_hdr_latency(results->u_latency_histogram,
                 "Uncorrected Latency (measured without taking delayed starts into account)");
         printf("----------------------------------------------------------\n");
     }
 
-    char *runtime_msg = format_time_us(runtime_us);
+    char *runtime_msg = format_time_us(results->runtime_us);
 
     printf("  %"PRIu64" requests in %s, %sB read\n",
-            complete, runtime_msg, format_binary(bytes));
-    if (errors.connect || errors.read || errors.write || errors.timeout || errors.reconnect) {
+            results->complete, runtime_msg, format_binary(results->bytes));
+    if (errors->connect || errors->read || errors->write || errors->timeout || errors->reconnect) {
         printf("  Socket errors: connect %d, read %d, write %d, timeout %d, reconnect %d\n",
-               errors.connect, errors.read, errors.write, errors.timeout, errors.reconnect);
+               errors->connect, errors->read, errors->write, errors->timeout, errors->reconnect);
+    }
+
+    if (results->catch_up || results->dropped) {
+        printf("  Behind schedule: %"PRIu64" catch-up requests (%.2Lf%%), %"PRIu64" dropped\n",
+               results->catch_up, results->catch_up * 100.0L / MAX(results->complete, 1),
+               results->dropped);
+    }
+
+    if (errors->unanswered) {
+        printf("  Unanswered requests at the end, recorded at their age: %d\n", errors->unanswered);
+    }
+
+    if (errors->range) {
+        char *max = format_time_us(cfg.hdr_max);
+        printf("  Latencies out of histogram range (> %s): %d\n", max, errors->range);
+    }
+
+    if (errors->status) {
+        printf("  Non-2xx or 3xx responses: %d\n", errors->status);
+        print_statuses(&results->statuses);
+        print_latency_table("outcome", (char *[]) { "Success", "Error" },
+                (struct hdr_histogram *[]) { results->success_histogram, results->error_histogram }, 2);
+    }
+
+    if (cfg.timestamps) {
+        print_wire_latency(results);
+    }
+
+    if (cfg.tcp_info) {
+        print_tcp_info(&results->tcp);
+    }
+
+    if (cfg.lua_gc) {
+        print_gc_stats(&results->gc);
     }
 
-    if (errors.status) {
-        printf("  Non-2xx or 3xx responses: %d\n", errors.status);
+    if (results->ntags > 0) {
+        char *names[MAX_TAGS];
+        struct hdr_histogram *histograms[MAX_TAGS];
+        for (int i = 0; i < results->ntags; i++) {
+            names[i]      = results->tags[i].name;
+            histograms[i] = results->tags[i].latency_histogram;
+        }
+        print_latency_table("tag", names, histograms, results->ntags);
     }
 
-    printf("Established connections: %u\n", errors.established);
+    printf("Established connections: %u\n", errors->established);
     printf("Requests/sec: %9.2Lf\n", req_per_s);
     printf("Transfer/sec: %10sB\n", format_binary(bytes_per_s));
 
+    if (histogram_log.file) write_hdr_log(results);
+
     if (script_has_done(L)) {
-        script_summary(L, runtime_us, complete, bytes);
-        script_errors(L, &errors);
-        script_done(L, latency_stats, statistics.requests);
+        script_summary(L, results->runtime_us, results->complete, results->bytes);
+        script_errors(L, errors);
+        script_statuses(L, &results->statuses);
+        script_latency(L, "success_latency", histogram_stats(results->success_histogram));
+        script_latency(L, "error_latency", histogram_stats(results->error_histogram));
+        if (results->ntags > 0) {
+            char *names[MAX_TAGS];
+            stats *latency[MAX_TAGS], *u_latency[MAX_TAGS];
+            for (int i = 0; i < results->ntags; i++) {
+                names[i]     = results->tags[i].name;
+                latency[i]   = histogram_stats(results->tags[i].latency_histogram);
+                u_latency[i] = histogram_stats(results->tags[i].u_latency_histogram);
+            }
+            script_tags(L, names, latency, u_latency, results->ntags);
+        }
+        script_done(L, latency_stats, requests_stats);
+    }
+}
+
+// Open the histogram log before the run so interval histograms can be
+// written while it is in progress.
+static void open_hdr_log(char *path) {
+    histogram_log.start = time_us();
+    if (!(histogram_log.file = fopen(path, "w")) ||
+        hdr_log_write_header(histogram_log.file, "wrk " VERSION, histogram_log.start / 1000000.0)) {
+        fprintf(stderr, "unable to open %s: %s\n", path, strerror(errno));
+        exit(1);
     }
+}
 
-    free(local_ip_tokens);
-    free(local_ip_arr);
+// Save the raw histograms so runs can be merged and compared later
+// with wrk-hist or any other HdrHistogram log reader.
+static void write_hdr_log(results *results) {
+    FILE *file = histogram_log.file;
+    double runtime_s = results->runtime_us / 1000000.0;
+    double start_s   = (time_us() - histogram_log.start) / 1000000.0 - runtime_s;
+    int rc = 0;
+
+    start_s = MAX(start_s, 0);
+    rc |= hdr_log_write(file, "latency", start_s, runtime_s, results->latency_histogram);
+    rc |= hdr_log_write(file, "u_latency", start_s, runtime_s, results->u_latency_histogram);
+    rc |= hdr_log_write(file, "success", start_s, runtime_s, results->success_histogram);
+    rc |= hdr_log_write(file, "error", start_s, runtime_s, results->error_histogram);
+    if (results->warmup_complete) {
+        double warmup_s = results->warmup_runtime_us / 1000000.0;
+        rc |= hdr_log_write(file, "warmup", MAX(start_s - warmup_s, 0), warmup_s, results->warmup_histogram);
+    }
+    if (cfg.timestamps) {
+        rc |= hdr_log_write(file, "wire", start_s, runtime_s, results->wire_histogram);
+    }
 
-    return 0;
+    for (int i = 0; i < results->ntags; i++) {
+        char name[256];
+        snprintf(name, sizeof(name), "tag.%s", results->tags[i].name);
+        for (char *p = name; *p; p++) {
+            if (*p == ',' || isspace(*p)) *p = '_';
+        }
+        rc |= hdr_log_write(file, name, start_s, runtime_s, results->tags[i].latency_histogram);
+    }
+
+    if (fclose(file) || rc) {
+        fprintf(stderr, "unable to write %s\n", cfg.hdr_log);
+    }
+    histogram_log.file = NULL;
+}
+
+// Sample the corrected latency of an interval from the recorders of the
+// threads, without pausing recording. Intervals are written untagged to
+// the histogram log, so standard log processors pick them up as a time
+// series, and their quantiles are kept for the metrics.
+static void log_interval(thread *threads, struct hdr_histogram *interval, uint64_t start, uint64_t now) {
+    double interval_s = (now - start) / 1000000.0;
+
+    hdr_reset(interval);
+    for (uint64_t i = 0; i < cfg.threads; i++) {
+        hdr_add(interval, hdr_recorder_sample(&threads[i].recorder));
+    }
+
+    if (cfg.hdr_interval) {
+        double start_s = (start - histogram_log.start) / 1000000.0;
+        if (hdr_log_write(histogram_log.file, NULL, start_s, interval_s, interval)) {
+            fprintf(stderr, "unable to write %s\n", cfg.hdr_log);
+        }
+        fflush(histogram_log.file);
+    }
+
+    if (cfg.metrics) {
+        pthread_mutex_lock(&interval_latency.mutex);
+        interval_latency.interval_s = interval_s;
+        interval_latency.count      = interval->total_count;
+        for (int i = 0; i < METRICS_QUANTILES; i++) {
+            interval_latency.quantiles[i] = hdr_value_at_percentile(interval, metrics_quantiles[i]) / 1000000.0;
+        }
+        pthread_mutex_unlock(&interval_latency.mutex);
+    }
+}
+
+// Watch the threads until they finish, logging interval histograms and
+// serving the control socket in the meantime.
+static void supervise(thread *threads) {
+    uint64_t interval_us = cfg.interval * 1000000;
+    uint64_t start = time_us();
+    uint64_t next  = interval_us ? start + interval_us : UINT64_MAX;
+    struct hdr_histogram *interval = NULL;
+    bool finished = false;
+
+    if (interval_us) latency_histogram_init(&interval);
+
+    while (!finished) {
+        uint64_t now = time_us();
+        finished = __sync_fetch_and_add(&g_finished_threads, 0) == cfg.threads;
+
+        if (interval_us && (finished || now >= next)) {
+            log_interval(threads, interval, start, now);
+            start = now;
+            next  = now + interval_us;
+        }
+        if (finished) break;
+
+        uint64_t wait_us = MIN(next - now, CONTROL_POLL_MS * 1000);
+        if (cfg.control_socket) {
+            command_poll(&commands, (wait_us + 999) / 1000, control_command, threads);
+        } else {
+            usleep(wait_us);
+        }
+    }
+
+    free(interval);
+}
+
+// Queue a command for every thread, their event loops pick it up within
+// COMMAND_POLL_MS.
+static bool threads_command(thread *threads, command *cmd) {
+    bool queued = true;
+    for (uint64_t i = 0; i < cfg.threads; i++) {
+        queued &= command_push(&threads[i].commands, cmd);
+    }
+    return queued;
+}
+
+// Merge the latency histograms of every thread as of now, reply with a
+// summary and append them to --hdr_log under the snapshot tag.
+static void control_snapshot(int fd, thread *threads) {
+    static uint64_t seq = 0;
+    command cmd = { .type = CMD_SNAPSHOT, .seq = ++seq };
+    struct hdr_histogram *snapshot;
+    uint64_t complete = 0;
+
+    if (!threads_command(threads, &cmd)) {
+        command_reply(fd, "error: busy");
+        return;
+    }
+
+    latency_histogram_init(&snapshot);
+    for (uint64_t i = 0; i < cfg.threads; i++) {
+        thread *t = &threads[i];
+        while (__atomic_load_n(&t->snapshot_seq, __ATOMIC_ACQUIRE) != seq &&
+               !__atomic_load_n(&t->finished, __ATOMIC_ACQUIRE)) {
+            usleep(1000);
+        }
+        if (__atomic_load_n(&t->snapshot_seq, __ATOMIC_ACQUIRE) == seq) {
+            hdr_add_grow(&snapshot, t->snapshot);
+            complete += t->snapshot_complete;
+        } else {
+            hdr_add_grow(&snapshot, t->latency_histogram);
+            complete += t->complete;
+        }
+    }
+
+    command_reply(fd, "ok requests %"PRIu64" p50 %.3fms p90 %.3fms p99 %.3fms p99.9 %.3fms max %.3fms",
+                  complete,
+                  hdr_value_at_percentile(snapshot, 50.0) / 1000.0,
+                  hdr_value_at_percentile(snapshot, 90.0) / 1000.0,
+                  hdr_value_at_percentile(snapshot, 99.0) / 1000.0,
+                  hdr_value_at_percentile(snapshot, 99.9) / 1000.0,
+                  hdr_max(snapshot) / 1000.0);
+
+    if (histogram_log.file) {
+        double elapsed_s = (time_us() - histogram_log.start) / 1000000.0;
+        if (hdr_log_write(histogram_log.file, "snapshot", 0, elapsed_s, snapshot)) {
+            fprintf(stderr, "unable to write %s\n", cfg.hdr_log);
+        }
+        fflush(histogram_log.file);
+    }
+
+    free(snapshot);
+}
+
+// Run one line received on the control socket: rate <N>, connections
+// <N>, snapshot or stop. Rates and connections are totals, split evenly
+// between the threads like the command line options.
+static void control_command(int fd, char *line, void *data) {
+    thread *threads = data;
+    char *saveptr = NULL;
+    char *name = strtok_r(line, " \t", &saveptr);
+    char *arg  = strtok_r(NULL, " \t", &saveptr);
+    command cmd = { .type = 0 };
+    uint64_t n = 0;
+
+    if (!name) {
+        command_reply(fd, "error: expected rate <N>, connections <N>, snapshot or stop");
+        return;
+    }
+
+    if (arg && scan_metric(arg, &n)) {
+        command_reply(fd, "error: invalid number %s", arg);
+        return;
+    }
+
+    if (!strcmp(name, "rate") && arg) {
+        if (!n) {
+            command_reply(fd, "error: rate must be > 0");
+            return;
+        }
+        cmd.type  = CMD_RATE;
+        cmd.value = (double) n / cfg.threads;
+    } else if (!strcmp(name, "connections") && arg) {
+        if (n < cfg.threads || n > cfg.max_connections) {
+            command_reply(fd, "error: connections must be between %"PRIu64" and %"PRIu64,
+                          cfg.threads, cfg.max_connections);
+            return;
+        }
+        cmd.type  = CMD_CONNECTIONS;
+        cmd.value = n / cfg.threads;
+    } else if (!strcmp(name, "snapshot") && !arg) {
+        control_snapshot(fd, threads);
+        return;
+    } else if (!strcmp(name, "stop") && !arg) {
+        cmd.type = CMD_STOP;
+    } else {
+        command_reply(fd, "error: expected rate <N>, connections <N>, snapshot or stop");
+        return;
+    }
+
+    command_reply(fd, threads_command(threads, &cmd) ? "ok" : "error: busy");
+}
+
+#define LOAD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+
+static void metric(char **text, char *name, char *type, char *help) {
+    aprintf(text, "# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+// Render the live state of the threads as OpenMetrics text, for the
+// metrics thread. Counters are read without locks while the threads
+// update them, so each is current but together they are not an atomic
+// snapshot. Latency quantiles are those of the last complete interval.
+static char *metrics_text(void *data) {
+    thread *threads = data;
+    uint64_t complete = 0, bytes = 0, catch_up = 0, dropped = 0, connections = 0, lag = 0;
+    double rate = 0, interval_s, quantiles[METRICS_QUANTILES];
+    uint64_t count;
+    errors e = { 0 };
+    char *text = NULL;
+
+    for (uint64_t i = 0; i < cfg.threads; i++) {
+        thread *t = &threads[i];
+        double thread_rate;
+
+        complete    += LOAD(t->complete);
+        bytes       += LOAD(t->bytes);
+        catch_up    += LOAD(t->catch_up);
+        dropped     += LOAD(t->dropped);
+        connections += LOAD(t->connections);
+        lag          = MAX(lag, LOAD(t->lag));
+        __atomic_load(&t->rate, &thread_rate, __ATOMIC_RELAXED);
+        rate        += thread_rate;
+
+        e.connect     += LOAD(t->errors.connect);
+        e.read        += LOAD(t->errors.read);
+        e.write       += LOAD(t->errors.write);
+        e.status      += LOAD(t->errors.status);
+        e.timeout     += LOAD(t->errors.timeout);
+        e.established += LOAD(t->errors.established);
+        e.reconnect   += LOAD(t->errors.reconnect);
+        e.range       += LOAD(t->errors.range);
+        e.unanswered  += LOAD(t->errors.unanswered);
+    }
+
+    pthread_mutex_lock(&interval_latency.mutex);
+    interval_s = interval_latency.interval_s;
+    count      = interval_latency.count;
+    memcpy(quantiles, interval_latency.quantiles, sizeof(quantiles));
+    pthread_mutex_unlock(&interval_latency.mutex);
+
+    metric(&text, "wrk_requests", "counter", "Responses received while measuring.");
+    aprintf(&text, "wrk_requests_total %"PRIu64"\n", complete);
+    metric(&text, "wrk_bytes", "counter", "Bytes read while measuring.");
+    aprintf(&text, "wrk_bytes_total %"PRIu64"\n", bytes);
+    metric(&text, "wrk_errors", "counter", "Errors by type.");
+    aprintf(&text, "wrk_errors_total{type=\"connect\"} %"PRIu32"\n", e.connect);
+    aprintf(&text, "wrk_errors_total{type=\"read\"} %"PRIu32"\n", e.read);
+    aprintf(&text, "wrk_errors_total{type=\"write\"} %"PRIu32"\n", e.write);
+    aprintf(&text, "wrk_errors_total{type=\"status\"} %"PRIu32"\n", e.status);
+    aprintf(&text, "wrk_errors_total{type=\"timeout\"} %"PRIu32"\n", e.timeout);
+    aprintf(&text, "wrk_errors_total{type=\"range\"} %"PRIu32"\n", e.range);
+    aprintf(&text, "wrk_errors_total{type=\"unanswered\"} %"PRIu32"\n", e.unanswered);
+    metric(&text, "wrk_reconnects", "counter", "Connections reopened after an error or close.");
+    aprintf(&text, "wrk_reconnects_total %"PRIu32"\n", e.reconnect);
+    metric(&text, "wrk_established", "counter", "Connections established.");
+    aprintf(&text, "wrk_established_total %"PRIu32"\n", e.established);
+    metric(&text, "wrk_catch_up_requests", "counter", "Requests sent more than one interval behind schedule.");
+    aprintf(&text, "wrk_catch_up_requests_total %"PRIu64"\n", catch_up);
+    metric(&text, "wrk_dropped_requests", "counter", "Requests skipped by --catch_up drop.");
+    aprintf(&text, "wrk_dropped_requests_total %"PRIu64"\n", dropped);
+    metric(&text, "wrk_connections", "gauge", "Connections the threads keep open.");
+    aprintf(&text, "wrk_connections %"PRIu64"\n", connections);
+    metric(&text, "wrk_allocated_bytes", "gauge", "Memory allocated, including thread arenas.");
+    aprintf(&text, "wrk_allocated_bytes %zu\n", zmalloc_used_memory());
+    metric(&text, "wrk_arena_bytes", "gauge", "Memory mapped by thread arenas.");
+    aprintf(&text, "wrk_arena_bytes %zu\n", zmalloc_mapped_memory());
+    metric(&text, "wrk_target_rate", "gauge", "Target request rate, in requests per second.");
+    aprintf(&text, "wrk_target_rate %.3f\n", rate);
+    metric(&text, "wrk_achieved_rate", "gauge", "Response rate over the last interval, in responses per second.");
+    aprintf(&text, "wrk_achieved_rate %.3f\n", interval_s > 0 ? count / interval_s : 0);
+    metric(&text, "wrk_lag_seconds", "gauge", "How late after its scheduled time the latest request was sent.");
+    aprintf(&text, "wrk_lag_seconds %.6f\n", lag / 1000000.0);
+    metric(&text, "wrk_interval_latency_seconds", "gauge", "Corrected latency quantiles over the last interval.");
+    for (int i = 0; i < METRICS_QUANTILES; i++) {
+        aprintf(&text, "wrk_interval_latency_seconds{quantile=\"%g\"} %.6f\n",
+                metrics_quantiles[i] / 100.0, quantiles[i]);
+    }
+    aprintf(&text, "# EOF\n");
+
+    return text;
+}
+
+static void latency_histogram_init(struct hdr_histogram **histogram) {
+    if (hdr_init(1, cfg.hdr_max, cfg.hdr_digits, histogram)) {
+        fprintf(stderr, "unable to allocate latency histogram\n");
+        exit(1);
+    }
+}
+
+static void results_init(results *results) {
+    memset(results, 0, sizeof(*results));
+    latency_histogram_init(&results->latency_histogram);
+    latency_histogram_init(&results->u_latency_histogram);
+    latency_histogram_init(&results->success_histogram);
+    latency_histogram_init(&results->error_histogram);
+    hdr_init(1, MAX_LATENCY, 3, &results->requests_histogram);
+    latency_histogram_init(&results->warmup_histogram);
+    latency_histogram_init(&results->wire_histogram);
+    tcp_stats_init(&results->tcp);
+    latency_histogram_init(&results->gc.pauses);
+}
+
+static void tcp_stats_init(tcp_stats *tcp) {
+    memset(tcp, 0, sizeof(*tcp));
+    latency_histogram_init(&tcp->rtt);
+    latency_histogram_init(&tcp->rttvar);
+    hdr_init(1, TCP_INFO_MAX_SEGMENTS, 3, &tcp->cwnd);
+    hdr_init(1, TCP_INFO_MAX_SEGMENTS, 3, &tcp->unacked);
+}
+
+static void tcp_stats_reset(tcp_stats *tcp) {
+    tcp->samples     = 0;
+    tcp->retransmits = 0;
+    hdr_reset(tcp->rtt);
+    hdr_reset(tcp->rttvar);
+    hdr_reset(tcp->cwnd);
+    hdr_reset(tcp->unacked);
+}
+
+static void tcp_stats_merge(tcp_stats *dst, tcp_stats *src) {
+    dst->samples     += src->samples;
+    dst->retransmits += src->retransmits;
+    hdr_add_grow(&dst->rtt, src->rtt);
+    hdr_add_grow(&dst->rttvar, src->rttvar);
+    hdr_add(dst->cwnd, src->cwnd);
+    hdr_add(dst->unacked, src->unacked);
+}
+
+static void gc_stats_reset(gc_stats *gc) {
+    gc->steps     = 0;
+    gc->cycles    = 0;
+    gc->automatic = 0;
+    gc->time      = 0;
+    hdr_reset(gc->pauses);
+}
+
+static void gc_stats_merge(gc_stats *dst, gc_stats *src) {
+    dst->steps     += src->steps;
+    dst->cycles    += src->cycles;
+    dst->automatic += src->automatic;
+    dst->time      += src->time;
+    hdr_add_grow(&dst->pauses, src->pauses);
+}
+
+static void results_merge(results *dst, results *src) {
+    dst->runtime_us = MAX(dst->runtime_us, src->runtime_us);
+    dst->complete  += src->complete;
+    dst->bytes     += src->bytes;
+
+    stats_merge_errors(&dst->errors, &src->errors);
+    stats_merge_statuses(&dst->statuses, &src->statuses);
+
+    hdr_add_grow(&dst->latency_histogram, src->latency_histogram);
+    hdr_add_grow(&dst->u_latency_histogram, src->u_latency_histogram);
+    hdr_add_grow(&dst->success_histogram, src->success_histogram);
+    hdr_add_grow(&dst->error_histogram, src->error_histogram);
+    hdr_add_grow(&dst->requests_histogram, src->requests_histogram);
+
+    dst->warmup_runtime_us = MAX(dst->warmup_runtime_us, src->warmup_runtime_us);
+    dst->warmup_complete  += src->warmup_complete;
+    dst->catch_up += src->catch_up;
+    dst->dropped  += src->dropped;
+    hdr_add_grow(&dst->warmup_histogram, src->warmup_histogram);
+    hdr_add_grow(&dst->wire_histogram, src->wire_histogram);
+    tcp_stats_merge(&dst->tcp, &src->tcp);
+    gc_stats_merge(&dst->gc, &src->gc);
+
+    for (int i = 0; i < src->ntags; i++) {
+        tag_merge(dst->tags, &dst->ntags, &src->tags[i]);
+    }
+}
+
+// Share of total given to worker index out of count, the remainder
+// goes to the first workers.
+static uint64_t worker_share(uint64_t total, uint32_t index, uint32_t count) {
+    return total / count + (index < total % count);
+}
+
+// Split the load between local and remote workers, merge their results
+// exactly and report them as a single run.
+static void coordinate(char *url, char **headers, int argc, char **argv) {
+    uint32_t count = cfg.processes + csv_nr(cfg.workers);
+    uint64_t threads = 0;
+    size_t n;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t connections = worker_share(cfg.connections, i, count);
+        threads += MAX(1, MIN(worker_share(cfg.threads, i, count), connections));
+    }
+
+    lua_State *L = script_create(cfg.script, url, headers);
+
+    struct sigaction sa = {
+        .sa_handler = handler,
+        .sa_flags   = 0,
+    };
+    sigfillset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+
+    char *time = format_time_s(cfg.duration);
+    printf("Running %s test @ %s\n", time, url);
+    printf("  %"PRIu32" workers, %"PRIu64" threads and %"PRIu64" connections\n",
+            count, threads, cfg.connections);
+    fflush(stdout);
+
+    results *workers = coordinator_run(cfg.processes, cfg.workers, argc, argv,
+                                       worker_main, &stop, &n);
+
+    results results;
+    results_init(&results);
+    for (size_t i = 0; i < n; i++) {
+        results_merge(&results, &workers[i]);
+    }
+
+    report(L, &results);
+}
+
+// Worker side of a coordinated run: receive the command line from the
+// coordinator, run our share of the benchmark and send back the results.
+static void worker_main(int fd) {
+    uint32_t type, index, count;
+    char *data, **argv;
+    size_t len;
+    int argc;
+
+    if (control_recv(fd, &type, &data, &len, CONTROL_ARGS_MAX) || type != MSG_ARGS ||
+        control_args_decode(data, len, &index, &count, &argc, &argv)) {
+        fprintf(stderr, "invalid request from coordinator\n");
+        exit(1);
+    }
+
+    char *url, **headers = zmalloc(argc * sizeof(char *));
+    struct http_parser_url parts = {};
+
+    optind = 0;
+    if (parse_args(&cfg, &url, &parts, headers, argc, argv)) {
+        char *msg = "invalid arguments";
+        control_send(fd, MSG_ERROR, msg, strlen(msg));
+        exit(1);
+    }
+
+    cfg.processes   = 0;
+    cfg.workers     = NULL;
+    cfg.hdr_log     = NULL;
+    cfg.rate        = worker_share(cfg.rate, index, count);
+    cfg.warmup_rate[0]  = worker_share(cfg.warmup_rate[0], index, count);
+    cfg.warmup_rate[1]  = worker_share(cfg.warmup_rate[1], index, count);
+    cfg.warmup_requests = worker_share(cfg.warmup_requests, index, count);
+    cfg.connections = worker_share(cfg.connections, index, count);
+    cfg.threads     = MAX(1, MIN(worker_share(cfg.threads, index, count), cfg.connections));
+    cfg.coordinated = true;
+    cfg.warmup      = true;
+    cfg.control     = fd;
+
+    results results;
+    benchmark(url, &parts, headers, argc, argv, &results);
+
+    buffer b = { 0 };
+    results_encode(&results, &b);
+    control_send(fd, MSG_RESULTS, b.buffer, b.cursor - b.buffer);
+    close(fd);
+}
+
+// Tell the coordinator once every thread is warmed up, release them all
+// on START and stop early if the coordinator asks or goes away.
+static void worker_run() {
+    struct pollfd pfd = { .fd = cfg.control, .events = POLLIN };
+    uint32_t type;
+    char *data;
+    size_t len;
+
+    while (__sync_fetch_and_add(&g_ready_threads, 0) < cfg.threads) {
+        usleep(1000);
+    }
+
+    if (control_send(cfg.control, MSG_READY, NULL, 0) ||
+        control_recv(cfg.control, &type, &data, &len, CONTROL_ARGS_MAX) || type != MSG_START) {
+        fprintf(stderr, "lost connection to coordinator\n");
+        exit(1);
+    }
+    zfree(data);
+    g_is_ready = 1;
+
+    while (!stop && __sync_fetch_and_add(&g_finished_threads, 0) < cfg.threads) {
+        if (poll(&pfd, 1, CONTROL_POLL_MS) <= 0) continue;
+        if (control_recv(cfg.control, &type, &data, &len, CONTROL_ARGS_MAX)) {
+            stop = 1;
+            continue;
+        }
+        zfree(data);
+        if (type == MSG_STOP) stop = 1;
+    }
+}
+
+// Find the tag with the given name, appending a new one if necessary.
+// Returns NULL when all MAX_TAGS are taken by other names.
+static tag *tag_lookup(tag *tags, int *ntags, const char *name) {
+    for (int i = 0; i < *ntags; i++) {
+        if (!strcmp(tags[i].name, name)) return &tags[i];
+    }
+
+    if (*ntags == MAX_TAGS) return NULL;
+
+    tag *tag = &tags[(*ntags)++];
+    tag->name = zstrdup(name);
+    latency_histogram_init(&tag->latency_histogram);
+    latency_histogram_init(&tag->u_latency_histogram);
+    return tag;
+}
+
+// Add the latencies of src to the tag of the same name. Threads and
+// workers may each use different names, so their union can exceed
+// MAX_TAGS; latencies of the extra tags are then only in the totals.
+static void tag_merge(tag *tags, int *ntags, tag *src) {
+    static bool warned = false;
+    tag *tag = tag_lookup(tags, ntags, src->name);
+
+    if (!tag) {
+        if (!warned) {
+            fprintf(stderr, "warning: more than %d request tags, "
+                    "the latency of the rest is only in the totals\n", MAX_TAGS);
+            warned = true;
+        }
+        return;
+    }
+    hdr_add_grow(&tag->latency_histogram, src->latency_histogram);
+    hdr_add_grow(&tag->u_latency_histogram, src->u_latency_histogram);
 }
 
 static void phase_move(thread *thread, int phase) {
@@ -345,48 +1299,101 @@ static void phase_move(thread *thread, int phase) {
                 aeCreateFileEvent(thread->loop, c->fd, AE_WRITABLE, socket_writeable, c);
             }
         }
-        aeCreateTimeEvent(thread->loop, CALIBRATE_DELAY_MS, calibrate, thread, NULL);
         thread->start = time_us();
         thread->phase_normal_start = thread->start;
+        if (cfg.coordinated) {
+            thread->stop_at = thread->start + cfg.duration * 1000000;
+        }
+        calibration_start(thread);
     }
 
     thread->phase = phase;
 }
 
+// Allocate from the arena of the thread, which lives until the results
+// of the thread are merged.
+static void *thread_alloc(thread *thread, size_t size) {
+    void *ptr = arena_alloc(&thread->arena, size);
+    if (!ptr) {
+        fprintf(stderr, "unable to map %zu bytes: %s\n", size, strerror(errno));
+        exit(1);
+    }
+    return ptr;
+}
+
+// Histograms the thread records into live in its arena, except with
+// --hdr_auto where they must be reallocated as they grow.
+static void thread_histogram_init(thread *thread, struct hdr_histogram **histogram, int64_t max, int digits) {
+    size_t size = hdr_calculate_size(1, max, digits);
+
+    if (cfg.hdr_auto || !size) {
+        if (hdr_init(1, max, digits, histogram)) {
+            fprintf(stderr, "unable to allocate latency histogram\n");
+            exit(1);
+        }
+        return;
+    }
+
+    *histogram = thread_alloc(thread, size);
+    hdr_init_preallocated(1, max, digits, *histogram);
+}
+
 void *thread_main(void *arg) {
     thread *thread = arg;
     aeEventLoop *loop = thread->loop;
 
-    thread->cs = zcalloc(thread->connections * sizeof(connection));
+    arena_init(&thread->arena, cfg.huge_pages);
+    thread->cs = thread_alloc(thread, thread->max_connections * sizeof(connection));
     tinymt64_init(&thread->rand, time_us());
-    hdr_init(1, MAX_LATENCY, 3, &thread->latency_histogram);
-    hdr_init(1, MAX_LATENCY, 3, &thread->u_latency_histogram);
+    thread_histogram_init(thread, &thread->latency_histogram, cfg.hdr_max, cfg.hdr_digits);
+    thread_histogram_init(thread, &thread->u_latency_histogram, cfg.hdr_max, cfg.hdr_digits);
+    thread_histogram_init(thread, &thread->success_histogram, cfg.hdr_max, cfg.hdr_digits);
+    thread_histogram_init(thread, &thread->error_histogram, cfg.hdr_max, cfg.hdr_digits);
+    thread_histogram_init(thread, &thread->warmup_histogram, cfg.hdr_max, cfg.hdr_digits);
+    thread_histogram_init(thread, &thread->wire_histogram, cfg.hdr_max, cfg.hdr_digits);
+    memset(&thread->tcp, 0, sizeof(thread->tcp));
+    thread_histogram_init(thread, &thread->tcp.rtt, cfg.hdr_max, cfg.hdr_digits);
+    thread_histogram_init(thread, &thread->tcp.rttvar, cfg.hdr_max, cfg.hdr_digits);
+    thread_histogram_init(thread, &thread->tcp.cwnd, TCP_INFO_MAX_SEGMENTS, 3);
+    thread_histogram_init(thread, &thread->tcp.unacked, TCP_INFO_MAX_SEGMENTS, 3);
+    memset(&thread->gc, 0, sizeof(thread->gc));
+    thread_histogram_init(thread, &thread->gc.pauses, cfg.hdr_max, cfg.hdr_digits);
+    thread->same_layout = hdr_same_layout(thread->latency_histogram, thread->u_latency_histogram) &&
+                          hdr_same_layout(thread->latency_histogram, thread->success_histogram) &&
+                          hdr_same_layout(thread->latency_histogram, thread->error_histogram);
 
     char *request = NULL;
     size_t length = 0;
 
-    if (!cfg.dynamic) {
+    thread->template = script_template(thread->L);
+    if (!cfg.dynamic && !thread->template) {
         script_request(thread->L, &request, &length);
     }
 
     double throughput = (thread->throughput / 1000000.0) / thread->connections;
+    thread->rate = thread->throughput;
 
     connection *c = thread->cs;
 
     for (uint64_t i = 0; i < thread->connections; i++, c++) {
-        c->thread     = thread;
-        c->ssl        = cfg.ctx ? SSL_new(cfg.ctx) : NULL;
-        c->request    = request;
-        c->length     = length;
-        c->throughput = throughput;
-        c->catch_up_throughput = throughput * 2;
-        c->complete   = 0;
-        c->caught_up  = true;
+        connection_init(thread, c, request, length, throughput);
         // Stagger connects 5 msec apart within thread:
         aeCreateTimeEvent(loop, i * 5, delayed_initial_connect, c, NULL);
     }
 
-    aeCreateTimeEvent(loop, STOP_CHECK_INTERNAL_MS, check_stop, thread, NULL);
+    thread->stop_timer = aeCreateTimeEvent(loop, STOP_CHECK_INTERNAL_MS, check_stop, thread, NULL);
+    if (cfg.control_socket) {
+        aeCreateTimeEvent(loop, COMMAND_POLL_MS, thread_commands, thread, NULL);
+    }
+    if (cfg.tcp_info) {
+        aeCreateTimeEvent(loop, TCP_INFO_INTERVAL_MS, sample_tcp_info, thread, NULL);
+    }
+    aeSetSpin(loop, cfg.spin);
+    if (cfg.lua_gc) {
+        lua_gc(thread->L, LUA_GCSTOP, 0);
+        thread->gc_live = lua_gc(thread->L, LUA_GCCOUNT, 0);
+        aeSetBeforeSleepProc(loop, thread_gc, thread);
+    }
     if (cfg.warmup) {
         uint64_t warmup_timeout = cfg.warmup_timeout;
         if (!warmup_timeout) {
@@ -402,14 +1409,38 @@ void *thread_main(void *arg) {
 
     thread->start = time_us();
     thread->phase = cfg.warmup ? PHASE_WARMUP : PHASE_NORMAL;
+    if (!cfg.warmup && (cfg.steady || cfg.warmup_duration || cfg.warmup_requests)) {
+        calibration_start(thread);
+    }
     aeMain(loop);
 
+    for (uint64_t i = 0; i < thread->max_connections; i++) {
+        buffer_release(&thread->cs[i].headers);
+        buffer_release(&thread->cs[i].body);
+    }
+    buffer_pool_free(&thread->buffers);
     aeDeleteEventLoop(loop);
-    zfree(thread->cs);
+    __atomic_store_n(&thread->finished, true, __ATOMIC_RELEASE);
+    __sync_add_and_fetch(&g_finished_threads, 1);
 
     return NULL;
 }
 
+static void connection_init(thread *thread, connection *c, char *request, size_t length, double throughput) {
+    c->thread     = thread;
+    c->ssl        = cfg.ctx ? SSL_new(cfg.ctx) : NULL;
+    c->request    = thread->template ? thread_alloc(thread, thread->template->max_length) : request;
+    c->length     = length;
+    c->tag        = -1;
+    c->fd         = -1;
+    c->throughput = throughput;
+    c->catch_up_throughput = throughput * cfg.catch_up_factor;
+    c->complete   = 0;
+    c->caught_up  = true;
+    c->headers.pool = &thread->buffers;
+    c->body.pool    = &thread->buffers;
+}
+
 static const char *af_name(sa_family_t family)
 {
     switch (family) {
@@ -496,53 +1527,263 @@ static int connect_socket(thread *thread, connection *c) {
         if (errno != EINPROGRESS) goto error;
     }
 
-    flags = 1;
-    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flags, sizeof(flags));
+    flags = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flags, sizeof(flags));
+
+#ifdef SO_BUSY_POLL
+    if (cfg.busy_poll) set_busy_poll(fd);
+#endif
+
+    c->latest_connect = time_us();
+
+    flags = AE_READABLE | AE_WRITABLE;
+    c->connect_mask = flags;
+    if (aeCreateFileEvent(loop, fd, flags, socket_connected, c) == AE_OK) {
+        c->parser.data = c;
+        c->fd = fd;
+        return fd;
+    }
+
+  error:
+    thread->errors.connect++;
+    close(fd);
+    c->fd = -1;
+    return -1;
+}
+
+#ifdef SO_BUSY_POLL
+// Have reads on the socket poll the device queue for up to --busy_poll
+// instead of waiting for an interrupt. Raising it above net.core.busy_read
+// needs CAP_NET_ADMIN, so failures are reported once and the run goes on.
+static void set_busy_poll(int fd) {
+    static int warned = 0;
+    int usecs = cfg.busy_poll, prefer = 1, rc;
+
+    rc = setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs));
+#ifdef SO_PREFER_BUSY_POLL
+    if (!rc) rc = setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer));
+#endif
+    if (rc && __sync_bool_compare_and_swap(&warned, 0, 1)) {
+        fprintf(stderr, "warning: unable to enable busy polling: %s\n", strerror(errno));
+    }
+}
+#endif
+
+static int reconnect_socket(thread *thread, connection *c) {
+    aeDeleteFileEvent(thread->loop, c->fd, AE_WRITABLE | AE_READABLE);
+    sock.close(c);
+    close(c->fd);
+    thread->errors.reconnect++;
+    return connect_socket(thread, c);
+}
+
+static int delayed_initial_connect(aeEventLoop *loop, long long id, void *data) {
+    connection* c = data;
+    // Connections removed over the control socket before they started.
+    if (c - c->thread->cs >= c->thread->connections) return AE_NOMORE;
+    c->thread_start = time_us();
+    connect_socket(c->thread, c);
+    return AE_NOMORE;
+}
+
+// Start measuring after warmup traffic, after a fixed calibration delay
+// or, with --steady, once the thread reaches a steady state.
+static void calibration_start(thread *thread) {
+    if (cfg.warmup_duration || cfg.warmup_requests) {
+        warmup_start(thread);
+    } else if (cfg.steady) {
+        steady_start(thread);
+    } else {
+        aeCreateTimeEvent(thread->loop, CALIBRATE_DELAY_MS, calibrate, thread, NULL);
+    }
+}
+
+// Change the request rate of a connection, keeping the time the next
+// request is expected to start so requests in flight keep theirs.
+static void connection_set_rate(connection *c, double throughput) {
+    c->thread_start = c->thread_start + c->complete / c->throughput - c->complete / throughput;
+    c->throughput   = throughput;
+    c->catch_up_throughput = throughput * cfg.catch_up_factor;
+    c->caught_up    = true;
+}
+
+// Set the rate of a thread in requests/sec, split evenly between its
+// connections as thread_main does. Rates of zero are rejected by the
+// callers.
+static void thread_set_rate(thread *thread, double rate) {
+    double throughput = (rate / 1000000.0) / thread->connections;
+    connection *c = thread->cs;
+
+    thread->rate = rate;
+
+    for (uint64_t i = 0; i < thread->connections; i++, c++) {
+        connection_set_rate(c, throughput);
+    }
+}
+
+static void warmup_start(thread *thread) {
+    thread->warmup_start    = time_us();
+    thread->stop_at         = UINT64_MAX;
+    thread->warmup_requests = cfg.warmup_requests ? MAX(cfg.warmup_requests / cfg.threads, 1) : 0;
+    thread_set_rate(thread, (double) cfg.warmup_rate[0] / cfg.threads);
+    aeCreateTimeEvent(thread->loop, WARMUP_TICK_MS, warmup_tick, thread, NULL);
+}
+
+// Ramp the warmup rate linearly with the progress of the warmup, by time
+// or by requests, whichever is further along.
+static int warmup_tick(aeEventLoop *loop, long long id, void *data) {
+    thread *thread = data;
+    double progress = 0;
+
+    if (cfg.warmup_duration) {
+        progress = (time_us() - thread->warmup_start) / (cfg.warmup_duration * 1000000.0);
+    }
+    if (thread->warmup_requests) {
+        progress = MAX(progress, (double) thread->complete / thread->warmup_requests);
+    }
+
+    if (progress >= 1) {
+        warmup_end(thread);
+        return AE_NOMORE;
+    }
+
+    if (cfg.warmup_rate[0] != cfg.warmup_rate[1]) {
+        double rate = cfg.warmup_rate[0] + ((double) cfg.warmup_rate[1] - cfg.warmup_rate[0]) * progress;
+        thread_set_rate(thread, rate / cfg.threads);
+    }
+    return WARMUP_TICK_MS;
+}
+
+// Keep the warmup latencies apart and measure the full duration from
+// here on, over the same connections. The run only ends during warmup
+// when it is interrupted.
+static void warmup_end(thread *thread) {
+    uint64_t now = time_us();
+
+    thread->warmup_runtime  = now - thread->warmup_start;
+    thread->warmup_complete = thread->complete;
+    // Only histograms on the heap can grow, see thread_histogram_init.
+    if (cfg.hdr_auto) {
+        hdr_add_grow(&thread->warmup_histogram, thread->latency_histogram);
+    } else {
+        hdr_add(thread->warmup_histogram, thread->latency_histogram);
+    }
+
+    thread_discard(thread);
+    thread->stop_at  = now + cfg.duration * 1000000;
+    thread_set_rate(thread, thread->throughput);
+
+    if (cfg.steady) {
+        steady_start(thread);
+    } else {
+        thread->phase_normal_start = now;
+        calibrate_thread(thread);
+    }
+}
+
+// Forget the responses counted so far, their latencies are reset by
+// calibrate_thread. Connection errors are kept, the connections are.
+static void thread_discard(thread *thread) {
+    thread->complete = 0;
+    thread->bytes    = 0;
+    thread->catch_up = 0;
+    thread->dropped  = 0;
+    memset(&thread->statuses, 0, sizeof(thread->statuses));
+    thread->errors.read    = 0;
+    thread->errors.write   = 0;
+    thread->errors.status  = 0;
+    thread->errors.timeout = 0;
+    thread->errors.range   = 0;
+}
+
+static void steady_start(thread *thread) {
+    steady_state *steady = &thread->steady;
+    latency_histogram_init(&steady->histogram);
+    steady->start    = time_us();
+    steady->last     = steady->start;
+    steady->complete = thread->complete;
+    steady->windows  = 0;
+    aeCreateTimeEvent(thread->loop, STEADY_INTERVAL_MS, steady_check, thread, NULL);
+}
+
+static bool steady_within(double *values, double tolerance, double slack) {
+    double mean = 0;
+    for (int i = 0; i < STEADY_WINDOWS; i++) mean += values[i] / STEADY_WINDOWS;
+    for (int i = 0; i < STEADY_WINDOWS; i++) {
+        if (fabs(values[i] - mean) > mean * tolerance + slack) return false;
+    }
+    return true;
+}
+
+// Compare the throughput and p90 latency of the last STEADY_WINDOWS
+// intervals and start measuring once both are stable, or after half of
+// the run at the latest. Everything before is discarded.
+static int steady_check(aeEventLoop *loop, long long id, void *data) {
+    thread *thread = data;
+    steady_state *steady = &thread->steady;
+    uint64_t now = time_us();
+    int window = steady->windows++ % STEADY_WINDOWS;
+
+    steady->rate[window]    = (thread->complete - steady->complete) * 1000000.0 / (now - steady->last);
+    steady->latency[window] = hdr_value_at_percentile(steady->histogram, 90.0);
+    steady->last     = now;
+    steady->complete = thread->complete;
+    hdr_reset(steady->histogram);
+
+    bool stable = steady->windows >= STEADY_WINDOWS && steady->rate[window] > 0 &&
+                  steady_within(steady->rate, cfg.steady, 0) &&
+                  steady_within(steady->latency, cfg.steady, STEADY_SLACK_US);
+    bool expired = now - steady->start >= cfg.duration * 1000000 / 2;
 
-    c->latest_connect = time_us();
+    if (!stable && !expired) return STEADY_INTERVAL_MS;
 
-    flags = AE_READABLE | AE_WRITABLE;
-    c->connect_mask = flags;
-    if (aeCreateFileEvent(loop, fd, flags, socket_connected, c) == AE_OK) {
-        c->parser.data = c;
-        c->fd = fd;
-        return fd;
+    double elapsed_s = (now - steady->start) / 1000000.0;
+    if (stable) {
+        printf("  Thread steady after %.1fs: %.0f requests/sec, p90 lat.: %.3fms\n",
+               elapsed_s, steady->rate[window], steady->latency[window] / 1000.0);
+    } else {
+        printf("  Thread not steady after %.1fs, measuring anyway\n", elapsed_s);
     }
 
-  error:
-    thread->errors.connect++;
-    close(fd);
-    return -1;
-}
+    free(steady->histogram);
+    steady->histogram = NULL;
 
-static int reconnect_socket(thread *thread, connection *c) {
-    aeDeleteFileEvent(thread->loop, c->fd, AE_WRITABLE | AE_READABLE);
-    sock.close(c);
-    close(c->fd);
-    thread->errors.reconnect++;
-    return connect_socket(thread, c);
-}
+    thread_discard(thread);
+    thread->phase_normal_start = now;
+    calibrate_thread(thread);
 
-static int delayed_initial_connect(aeEventLoop *loop, long long id, void *data) {
-    connection* c = data;
-    c->thread_start = time_us();
-    connect_socket(c->thread, c);
     return AE_NOMORE;
 }
 
 static int calibrate(aeEventLoop *loop, long long id, void *data) {
     thread *thread = data;
 
+    if (hdr_mean(thread->latency_histogram) == 0) return CALIBRATE_DELAY_MS;
+
+    calibrate_thread(thread);
+    return AE_NOMORE;
+}
+
+// Discard the latencies recorded so far and pick the rate sampling
+// interval from the latency seen while calibrating.
+static void calibrate_thread(thread *thread) {
     long double mean = hdr_mean(thread->latency_histogram);
     long double latency = hdr_value_at_percentile(
             thread->latency_histogram, 90.0) / 1000.0L;
     long double interval = MAX(latency * 2, 10);
 
-    if (mean == 0) return CALIBRATE_DELAY_MS;
-
     thread->mean     = (uint64_t) mean;
     hdr_reset(thread->latency_histogram);
     hdr_reset(thread->u_latency_histogram);
+    hdr_reset(thread->success_histogram);
+    hdr_reset(thread->error_histogram);
+    hdr_reset(thread->wire_histogram);
+    tcp_stats_reset(&thread->tcp);
+    gc_stats_reset(&thread->gc);
+    for (int i = 0; i < thread->ntags; i++) {
+        hdr_reset(thread->tags[i].latency_histogram);
+        hdr_reset(thread->tags[i].u_latency_histogram);
+    }
 
     thread->start    = time_us();
     thread->interval = interval;
@@ -552,31 +1793,171 @@ static int calibrate(aeEventLoop *loop, long long id, void *data) {
             (thread->mean)/1000.0,
             thread->interval);
 
-    aeCreateTimeEvent(loop, thread->interval, sample_rate, thread, NULL);
+    aeCreateTimeEvent(thread->loop, thread->interval, sample_rate, thread, NULL);
+}
 
-    return AE_NOMORE;
+static bool thread_has_pending(thread *thread) {
+    connection *c = thread->cs;
+    for (uint64_t i = 0; i < thread->connections; i++, c++) {
+        if (c->has_pending) return true;
+    }
+    return false;
 }
 
+// Fire exactly at stop_at, which may move while warming up, then stop
+// sending and wait up to --drain for the requests still in flight.
 static int check_stop(aeEventLoop *loop, long long id, void *data) {
     thread *thread = data;
     uint64_t now   = time_us();
 
-    if (stop || now >= thread->stop_at) {
+    if (!stop && now >= thread->stop_at && !thread->draining) {
+        thread->draining    = true;
+        thread->drain_until = thread->stop_at + cfg.drain;
+    }
+
+    if (stop || (thread->draining && (now >= thread->drain_until || !thread_has_pending(thread)))) {
+        record_unanswered(thread);
         aeStop(loop);
+        return STOP_CHECK_INTERNAL_MS;
+    }
+
+    if (thread->draining) {
+        return MIN(DRAIN_CHECK_INTERVAL_MS, (thread->drain_until - now + 999) / 1000);
+    }
+    return MAX(1, MIN(STOP_CHECK_INTERNAL_MS, (thread->stop_at - now + 999) / 1000));
+}
+
+// Requests still unanswered when the run ends took at least as long as
+// they have been in flight. Dropping them would hide the worst latencies
+// of an overloaded server, so record their age as an error.
+static void record_pending(thread *thread, connection *c, uint64_t now) {
+    if (!c->has_pending || !c->is_connected) return;
+
+    uint64_t expected_latency_start = c->thread_start +
+            (c->complete_at_last_batch_start / c->throughput);
+    uint64_t count = cfg.record_all_responses ? c->pending : 1;
+
+    for (uint64_t n = 0; n < count; n++) {
+        record_latency(thread, c->tag, now - expected_latency_start,
+                       now - c->actual_latency_start, true, false);
+    }
+    thread->errors.unanswered += c->pending;
+    c->has_pending = false;
+}
+
+static void record_unanswered(thread *thread) {
+    connection *c = thread->cs;
+    uint64_t now  = time_us();
+
+    for (uint64_t i = 0; i < thread->connections; i++, c++) {
+        record_pending(thread, c, now);
+    }
+}
+
+// Apply the commands queued by the control socket.
+static int thread_commands(aeEventLoop *loop, long long id, void *data) {
+    thread *thread = data;
+    command cmd;
+
+    while (command_pop(&thread->commands, &cmd)) {
+        switch (cmd.type) {
+            case CMD_RATE:
+                // Warmup traffic has its own rate, the new one applies after it.
+                thread->throughput = cmd.value;
+                if (!thread->warmup_start || thread->warmup_runtime) {
+                    thread_set_rate(thread, cmd.value);
+                }
+                break;
+            case CMD_CONNECTIONS:
+                thread_set_connections(thread, cmd.value);
+                break;
+            case CMD_SNAPSHOT:
+                if (thread->snapshot) {
+                    hdr_reset(thread->snapshot);
+                } else {
+                    latency_histogram_init(&thread->snapshot);
+                }
+                hdr_add_grow(&thread->snapshot, thread->latency_histogram);
+                thread->snapshot_complete = thread->complete;
+                __atomic_store_n(&thread->snapshot_seq, cmd.seq, __ATOMIC_RELEASE);
+                break;
+            case CMD_STOP:
+                // End the run like the duration does, draining requests in flight.
+                thread->stop_at = MIN(thread->stop_at, time_us());
+                aeDeleteTimeEvent(loop, thread->stop_timer);
+                thread->stop_timer = aeCreateTimeEvent(loop, 0, check_stop, thread, NULL);
+                break;
+        }
+    }
+
+    return COMMAND_POLL_MS;
+}
+
+// Open or close connections to have n of them, keeping the rate of the
+// thread. Requests in flight on closed connections are unanswered.
+static void thread_set_connections(thread *thread, uint64_t n) {
+    uint64_t now = time_us();
+    connection *c;
+
+    for (uint64_t i = n; i < thread->connections; i++) {
+        c = &thread->cs[i];
+        record_pending(thread, c, now);
+        if (c->fd != -1) {
+            aeDeleteFileEvent(thread->loop, c->fd, AE_WRITABLE | AE_READABLE);
+            sock.close(c);
+            close(c->fd);
+            c->fd = -1;
+        }
+        c->is_connected = false;
+    }
+
+    for (uint64_t i = thread->connections; i < n; i++) {
+        c = &thread->cs[i];
+        if (!c->thread) {
+            connection_init(thread, c, thread->cs[0].request, thread->cs[0].length, thread->cs[0].throughput);
+        }
+        c->complete     = 0;
+        c->thread_start = now;
+        c->has_pending  = false;
+        c->written      = 0;
+        connect_socket(thread, c);
     }
 
-    return STOP_CHECK_INTERNAL_MS;
+    thread->connections = n;
+    thread_set_rate(thread, thread->rate);
 }
 
 static int warmup_timed_out(aeEventLoop *loop, long long id, void *data) {
     thread *thread = data;
 
+    // Coordinated workers only start together, whatever the state of
+    // their connections.
+    if (cfg.coordinated) {
+        thread_ready(thread);
+        return AE_NOMORE;
+    }
+
     // It is safe to transit to NORMAL if we're already in NORMAL phase
     phase_move(thread, PHASE_NORMAL);
 
     return AE_NOMORE;
 }
 
+static void thread_ready(thread *thread) {
+    if (thread->ready) return;
+    thread->ready = true;
+
+    // Create a timed event to periodically check whether all threads are finished
+    // with handshakes. Without a synchronization can get high concurrency between
+    // TLS handshakes and requests.
+    aeCreateTimeEvent(thread->loop, cfg.coordinated ? COORDINATED_SYNC_INTERVAL_MS
+                      : THREAD_SYNC_INTERVAL_MS, inter_thread_sync, thread, NULL);
+    int counter = __sync_add_and_fetch(&g_ready_threads, 1);
+    if (counter == cfg.threads && !cfg.coordinated) {
+        g_is_ready = 1;
+    }
+}
+
 static int inter_thread_sync(aeEventLoop *loop, long long id, void *data) {
     thread *thread = data;
 
@@ -584,7 +1965,8 @@ static int inter_thread_sync(aeEventLoop *loop, long long id, void *data) {
         phase_move(thread, PHASE_NORMAL);
     }
 
-    return thread->phase == PHASE_NORMAL ? AE_NOMORE : THREAD_SYNC_INTERVAL_MS;
+    if (thread->phase == PHASE_NORMAL) return AE_NOMORE;
+    return cfg.coordinated ? COORDINATED_SYNC_INTERVAL_MS : THREAD_SYNC_INTERVAL_MS;
 }
 
 static int sample_rate(aeEventLoop *loop, long long id, void *data) {
@@ -603,8 +1985,121 @@ static int sample_rate(aeEventLoop *loop, long long id, void *data) {
     return thread->interval;
 }
 
+// Sample TCP_INFO of the next --tcp_info connections of the thread, in
+// turn, so that the cost stays bounded however many connections there
+// are. Retransmits are counted from the growth of the total per socket.
+static int sample_tcp_info(aeEventLoop *loop, long long id, void *data) {
+#ifdef __linux__
+    thread *thread = data;
+    tcp_stats *tcp = &thread->tcp;
+    uint64_t count = MIN(cfg.tcp_info, thread->connections);
+
+    for (uint64_t i = 0; i < count; i++) {
+        connection *c = &thread->cs[thread->tcp_next++ % thread->connections];
+        struct tcp_info info;
+        socklen_t len = sizeof(info);
+
+        if (!c->is_connected || getsockopt(c->fd, IPPROTO_TCP, TCP_INFO, &info, &len)) continue;
+
+        uint32_t total = info.tcpi_total_retrans;
+        tcp->retransmits += total >= c->tcp_retransmits ? total - c->tcp_retransmits : total;
+        c->tcp_retransmits = total;
+
+        tcp->samples++;
+        record_value(&tcp->rtt, info.tcpi_rtt);
+        record_value(&tcp->rttvar, info.tcpi_rttvar);
+        hdr_record_value(tcp->cwnd, info.tcpi_snd_cwnd);
+        hdr_record_value(tcp->unacked, info.tcpi_unacked);
+    }
+#endif
+    return TCP_INFO_INTERVAL_MS;
+}
+
+// Collect Lua garbage between events rather than when an allocation in
+// request() or response() happens to cross the threshold of the stopped
+// collector. Once the heap has grown by a quarter since the last cycle,
+// steps run for up to --lua_gc when the last poll found no socket ready
+// and the next timer is at least that far away. If the heap doubles
+// while the loop is busy the collector is restarted to pace itself
+// against allocations, as it would without --lua_gc, until idle again.
+static void thread_gc(aeEventLoop *loop, void *data) {
+    thread *thread = data;
+    lua_State *L = thread->L;
+    uint64_t heap = lua_gc(L, LUA_GCCOUNT, 0);
+    uint64_t live = thread->gc_live;
+
+    if (!thread->gc_running && heap < live + MAX(live / 4, LUA_GC_MIN_KB / 4)) return;
+
+    bool busy = loop->lastFired;
+    if (!busy) {
+        long long idle = aeTimeToNearestTimer(loop);
+        busy = idle >= 0 && (uint64_t) idle < cfg.lua_gc;
+    }
+
+    if (busy) {
+        if (!thread->gc_automatic && heap >= live * 2 + LUA_GC_MIN_KB) {
+            lua_gc(L, LUA_GCRESTART, 0);
+            thread->gc_automatic = true;
+            thread->gc.automatic++;
+        }
+        return;
+    }
+
+    uint64_t start = time_us(), now;
+    bool done;
+
+    do {
+        thread->gc.steps++;
+        done = lua_gc(L, LUA_GCSTEP, 0);
+        now  = time_us();
+    } while (!done && now - start < cfg.lua_gc);
+
+    // Stepping restarts the collector, keep it for idle time only.
+    lua_gc(L, LUA_GCSTOP, 0);
+    thread->gc_automatic = false;
+
+    thread->gc_running = !done;
+    if (done) {
+        thread->gc.cycles++;
+        thread->gc_live = lua_gc(L, LUA_GCCOUNT, 0);
+    }
+    thread->gc.time += now - start;
+    record_value(&thread->gc.pauses, now - start);
+}
+
+// Decide once per response, before anything is buffered, whether
+// response() will see it. Without any sampling options every response
+// is passed to the script.
+static bool response_sampled(connection *c, int status) {
+    thread *thread = c->thread;
+
+    if (c->sample != SAMPLE_UNKNOWN) return c->sample == SAMPLE_YES;
+
+    bool sampled = cfg.response_sample == 0 && cfg.response_rate == 0 && !cfg.response_errors;
+
+    if (cfg.response_errors && (status < 200 || status > 299)) {
+        sampled = true;
+    } else if (cfg.response_sample > 0 || cfg.response_rate > 0) {
+        sampled = cfg.response_sample == 0 ||
+                  tinymt64_generate_double(&thread->rand) < cfg.response_sample;
+
+        if (sampled && cfg.response_rate > 0) {
+            uint64_t now = time_us();
+            if (now - thread->sample_start >= 1000000) {
+                thread->sample_start = now;
+                thread->sampled = 0;
+            }
+            sampled = thread->sampled++ < cfg.response_rate;
+        }
+    }
+
+    c->sample = sampled ? SAMPLE_YES : SAMPLE_NO;
+    return sampled;
+}
+
 static int header_field(http_parser *parser, const char *at, size_t len) {
     connection *c = parser->data;
+    if (!response_sampled(c, parser->status_code)) return 0;
     if (c->state == VALUE) {
         *c->headers.cursor++ = '\0';
         c->state = FIELD;
@@ -615,6 +2110,7 @@ static int header_field(http_parser *parser, const char *at, size_t len) {
 
 static int header_value(http_parser *parser, const char *at, size_t len) {
     connection *c = parser->data;
+    if (!response_sampled(c, parser->status_code)) return 0;
     if (c->state == FIELD) {
         *c->headers.cursor++ = '\0';
         c->state = VALUE;
@@ -625,10 +2121,27 @@ static int header_value(http_parser *parser, const char *at, size_t len) {
 
 static int response_body(http_parser *parser, const char *at, size_t len) {
     connection *c = parser->data;
+    if (!response_sampled(c, parser->status_code)) return 0;
     buffer_append(&c->body, at, len);
     return 0;
 }
 
+// Skip missed requests of a connection that fell behind. Each counts as
+// dropped and is recorded with the latency it has accumulated so far,
+// so coordinated omission correction still sees the stall.
+static void drop_missed(connection *c, uint64_t next_start_time, uint64_t missed) {
+    thread *thread = c->thread;
+    uint64_t now   = time_us();
+
+    for (uint64_t i = 0; i < missed; i++) {
+        uint64_t expected_start = next_start_time + i / c->throughput;
+        record_latency(thread, -1, now - expected_start, 0, true, true);
+    }
+
+    c->complete     += missed;
+    thread->dropped += missed;
+}
+
 static uint64_t usec_to_next_send(connection *c) {
     uint64_t now = time_us();
 
@@ -640,6 +2153,16 @@ static uint64_t usec_to_next_send(connection *c) {
         // We are on pace. Indicate caught_up and don't send now.
         c->caught_up = true;
         send_now = false;
+    } else if (cfg.catch_up == CATCH_UP_DROP) {
+        // Skip the requests we are too late for and send the current one.
+        uint64_t missed = (now - next_start_time) * c->throughput;
+        if (missed) {
+            drop_missed(c, next_start_time, missed);
+            next_start_time = c->thread_start + (c->complete / c->throughput);
+        }
+    } else if (cfg.catch_up == CATCH_UP_UNLIMITED) {
+        // We are behind, send right away.
+        c->caught_up = false;
     } else {
         // We are behind
         if (c->caught_up) {
@@ -663,6 +2186,10 @@ static uint64_t usec_to_next_send(connection *c) {
     }
 
     if (send_now) {
+        // Sends more than a full interval past their slot are catch-up traffic.
+        uint64_t scheduled = c->thread_start + (c->complete / c->throughput);
+        c->behind = (now - scheduled) * c->throughput >= 1;
+        c->thread->lag = now - scheduled;
         c->latest_should_send_time = now;
         c->latest_expected_start = next_start_time;
     }
@@ -672,6 +2199,8 @@ static uint64_t usec_to_next_send(connection *c) {
 
 static int delay_request(aeEventLoop *loop, long long id, void *data) {
     connection* c = data;
+    // The connection was closed or is reconnecting, which resumes sending.
+    if (!c->is_connected) return AE_NOMORE;
     uint64_t time_usec_to_wait = usec_to_next_send(c);
     if (time_usec_to_wait) {
         return round((time_usec_to_wait / 1000.0L) + 0.5); /* don't send, wait */
@@ -680,29 +2209,94 @@ static int delay_request(aeEventLoop *loop, long long id, void *data) {
     return AE_NOMORE;
 }
 
+// Record a value at an index from hdr_counts_index. Values above the
+// range of the histogram grow it with --hdr_auto and are dropped (and
+// counted by the caller) otherwise.
+static bool record_index(struct hdr_histogram **histogram, int32_t index, int64_t value) {
+    if (hdr_record_index(*histogram, index)) return true;
+    if (!cfg.hdr_auto || value <= 0 || hdr_grow(histogram, value)) return false;
+    return hdr_record_index(*histogram, index);
+}
+
+static bool record_value(struct hdr_histogram **histogram, int64_t value) {
+    return record_index(histogram, hdr_counts_index(*histogram, value), value);
+}
+
+// Record the corrected (expected) and uncorrected (actual) latency of
+// a response in all of the thread's histograms it belongs in. Slots
+// dropped by --catch_up drop were never sent, so they only have a
+// corrected latency and count as errors.
+static void record_latency(thread *thread, int tag_id, int64_t expected_latency_timing,
+                           uint64_t actual_latency_timing, bool error, bool dropped) {
+    tag *tag = tag_id >= 0 ? &thread->tags[tag_id] : NULL;
+
+    if (cfg.interval) {
+        hdr_recorder_record_value(&thread->recorder, expected_latency_timing);
+    }
+    if (thread->steady.histogram) {
+        hdr_record_value(thread->steady.histogram, expected_latency_timing);
+    }
+
+    if (dropped) {
+        if (!record_value(&thread->latency_histogram, expected_latency_timing)) {
+            thread->errors.range++;
+        }
+        record_value(&thread->error_histogram, expected_latency_timing);
+        return;
+    }
+
+    if (thread->same_layout) {
+        // All histograms share a layout, index each value just once.
+        int32_t latency   = hdr_counts_index(thread->latency_histogram, expected_latency_timing);
+        int32_t u_latency = hdr_counts_index(thread->u_latency_histogram, actual_latency_timing);
+
+        if (!record_index(&thread->latency_histogram, latency, expected_latency_timing)) {
+            thread->errors.range++;
+        }
+        record_index(error ? &thread->error_histogram : &thread->success_histogram,
+                     latency, expected_latency_timing);
+        record_index(&thread->u_latency_histogram, u_latency, actual_latency_timing);
+        if (tag) {
+            record_index(&tag->latency_histogram, latency, expected_latency_timing);
+            record_index(&tag->u_latency_histogram, u_latency, actual_latency_timing);
+        }
+    } else {
+        if (!record_value(&thread->latency_histogram, expected_latency_timing)) {
+            thread->errors.range++;
+        }
+        record_value(error ? &thread->error_histogram : &thread->success_histogram,
+                     expected_latency_timing);
+        record_value(&thread->u_latency_histogram, actual_latency_timing);
+        if (tag) {
+            record_value(&tag->latency_histogram, expected_latency_timing);
+            record_value(&tag->u_latency_histogram, actual_latency_timing);
+        }
+    }
+}
+
 static int response_complete(http_parser *parser) {
     connection *c = parser->data;
     thread *thread = c->thread;
     uint64_t now = time_us();
     int status = parser->status_code;
+    bool error = status < 200 || status > 399;
 
     thread->complete++;
     thread->requests++;
 
-    if (status > 399) {
+    stats_record_status(&thread->statuses, status);
+    if (error) {
         thread->errors.status++;
     }
 
-    if (c->headers.buffer) {
-        *c->headers.cursor++ = '\0';
-        script_response(thread->L, status, &c->headers, &c->body);
+    if (cfg.response && response_sampled(c, status)) {
+        if (c->state == VALUE) *c->headers.cursor++ = '\0';
+        script_response(thread->L, status, &c->headers, &c->body, cfg.lazy_response);
         c->state = FIELD;
     }
-
-    if (now >= thread->stop_at) {
-        aeStop(thread->loop);
-        goto done;
-    }
+    buffer_release(&c->headers);
+    buffer_release(&c->body);
+    c->sample = SAMPLE_UNKNOWN;
 
     // Count all responses (including pipelined ones:)
     c->complete++;
@@ -751,12 +2345,13 @@ static int response_complete(http_parser *parser) {
 
     // Record if needed, either last in batch or all, depending in cfg:
     if (cfg.record_all_responses || !c->has_pending) {
-        hdr_record_value(thread->latency_histogram, expected_latency_timing);
-
-        uint64_t actual_latency_timing = now - c->actual_latency_start;
-        hdr_record_value(thread->u_latency_histogram, actual_latency_timing);
+        record_latency(thread, c->tag, expected_latency_timing,
+                       now - c->actual_latency_start, error, false);
     }
 
+    if (cfg.timestamps && !c->has_pending && c->tx_stamped && c->rx_timestamp > c->tx_timestamp) {
+        record_value(&thread->wire_histogram, (c->rx_timestamp - c->tx_timestamp) / 1000);
+    }
 
     if (!http_should_keep_alive(parser)) {
         reconnect_socket(thread, c);
@@ -808,9 +2403,20 @@ static void socket_connected(aeEventLoop *loop, int fd, void *data, int mask) {
     }
 
     http_parser_init(&c->parser, HTTP_RESPONSE);
+    buffer_release(&c->headers);
+    buffer_release(&c->body);
+    c->state   = FIELD;
     c->written = 0;
     c->thread->errors.established++;
     c->is_connected = true;
+    c->tcp_retransmits = 0;
+
+#ifdef SO_TIMESTAMPING
+    if (cfg.timestamps && sock_timestamps_enable(c)) {
+        fprintf(stderr, "unable to enable timestamps: %s\n", strerror(errno));
+        exit(1);
+    }
+#endif
 
     // Create file events only in NORMAL phase. We create the events for connected
     // sockets when move from WARMUP to NORMAL phase.
@@ -820,14 +2426,7 @@ static void socket_connected(aeEventLoop *loop, int fd, void *data, int mask) {
     }
 
     if (cfg.warmup && c->thread->errors.established == c->thread->connections) {
-        // Create a timed event to periodically check whether all threads are finished
-        // with handshakes. Without a synchronization can get high concurrency between
-        // TLS handshakes and requests.
-        aeCreateTimeEvent(c->thread->loop, THREAD_SYNC_INTERVAL_MS, inter_thread_sync, c->thread, NULL);
-        int counter = __sync_add_and_fetch(&g_ready_threads, 1);
-        if (counter == cfg.threads) {
-            g_is_ready = 1;
-        }
+        thread_ready(c->thread);
     }
 
     return;
@@ -842,6 +2441,11 @@ static void socket_writeable(aeEventLoop *loop, int fd, void *data, int mask) {
     connection *c = data;
     thread *thread = c->thread;
 
+    if (!c->written && thread->draining) {
+        aeDeleteFileEvent(loop, fd, AE_WRITABLE);
+        return;
+    }
+
     if (!c->written) {
         uint64_t time_usec_to_wait = usec_to_next_send(c);
         if (time_usec_to_wait) {
@@ -853,11 +2457,18 @@ static void socket_writeable(aeEventLoop *loop, int fd, void *data, int mask) {
                     thread->loop, msec_to_wait, delay_request, c, NULL);
             return;
         }
+        if (c->behind) thread->catch_up++;
         c->latest_write = time_us();
     }
 
     if (!c->written && cfg.dynamic) {
-        script_request(thread->L, &c->request, &c->length);
+        c->tag = script_request(thread->L, &c->request, &c->length);
+        while (c->tag >= thread->ntags) {
+            const char *name = script_tag_name(thread->L, thread->ntags);
+            tag_lookup(thread->tags, &thread->ntags, name);
+        }
+    } else if (!c->written && thread->template) {
+        c->length = template_render(thread->template, &thread->rand, c->request);
     }
 
     char  *buf = c->request + c->written;
@@ -880,9 +2491,13 @@ static void socket_writeable(aeEventLoop *loop, int fd, void *data, int mask) {
         case RETRY: return;
     }
 
-    c->written += n;
+    c->written  += n;
+    c->tx_bytes += n;
     if (c->written == c->length) {
-        c->written = 0;
+        // The kernel numbers write timestamps by the offset of their last byte.
+        c->tx_id      = c->tx_bytes - 1;
+        c->tx_stamped = false;
+        c->written    = 0;
         aeDeleteFileEvent(loop, fd, AE_WRITABLE);
     }
 
@@ -898,6 +2513,10 @@ static void socket_readable(aeEventLoop *loop, int fd, void *data, int mask) {
     connection *c = data;
     size_t n;
 
+#ifdef SO_TIMESTAMPING
+    if (cfg.timestamps) sock_tx_timestamps(c);
+#endif
+
     do {
         switch (sock.read(c, &n)) {
             case OK:    break;
@@ -946,15 +2565,46 @@ static struct option longopts[] = {
     { "u_latency",      no_argument,       NULL, 'U' },
     { "batch_latency",  no_argument,       NULL, 'B' },
     { "timeout",        required_argument, NULL, 'T' },
+    { "drain",          required_argument, NULL, OPT_DRAIN },
+    { "catch_up",       required_argument, NULL, OPT_CATCH_UP },
+    { "timestamps",     required_argument, NULL, OPT_TIMESTAMPS },
+    { "tcp_info",       required_argument, NULL, OPT_TCP_INFO },
+    { "spin",           required_argument, NULL, OPT_SPIN },
+    { "busy_poll",      required_argument, NULL, OPT_BUSY_POLL },
+    { "huge_pages",     required_argument, NULL, OPT_HUGE_PAGES },
+    { "lua_gc",         required_argument, NULL, OPT_LUA_GC },
     { "help",           no_argument,       NULL, 'h' },
     { "version",        no_argument,       NULL, 'v' },
     { "rate",           required_argument, NULL, 'R' },
     { "warmup",         no_argument,       NULL, 'W' },
+    { "response_sample", required_argument, NULL, OPT_RESPONSE_SAMPLE },
+    { "response_rate",  required_argument, NULL, OPT_RESPONSE_RATE },
+    { "response_errors", no_argument,      NULL, OPT_RESPONSE_ERRORS },
+    { "processes",      required_argument, NULL, OPT_PROCESSES },
+    { "workers",        required_argument, NULL, OPT_WORKERS },
+    { "serve",          required_argument, NULL, OPT_SERVE },
+    { "hdr_log",        required_argument, NULL, OPT_HDR_LOG },
+    { "hdr_digits",     required_argument, NULL, OPT_HDR_DIGITS },
+    { "hdr_max",        required_argument, NULL, OPT_HDR_MAX },
+    { "hdr_auto",       no_argument,       NULL, OPT_HDR_AUTO },
+    { "hdr_interval",   required_argument, NULL, OPT_HDR_INTERVAL },
+    { "steady",         required_argument, NULL, OPT_STEADY },
+    { "warmup_duration", required_argument, NULL, OPT_WARMUP_DURATION },
+    { "warmup_requests", required_argument, NULL, OPT_WARMUP_REQUESTS },
+    { "warmup_rate",    required_argument, NULL, OPT_WARMUP_RATE },
+    { "control",        required_argument, NULL, OPT_CONTROL },
+    { "max_connections", required_argument, NULL, OPT_MAX_CONNECTIONS },
+    { "metrics",        required_argument, NULL, OPT_METRICS },
+    { "self_test",      no_argument,       NULL, OPT_SELF_TEST },
+    { "responder_size", required_argument, NULL, OPT_RESPONDER_SIZE },
+    { "responder_delay", required_argument, NULL, OPT_RESPONDER_DELAY },
+    { "responder_dist", required_argument, NULL, OPT_RESPONDER_DIST },
     { NULL,             0,                 NULL,  0  }
 };
 
 static int parse_args(struct config *cfg, char **url, struct http_parser_url *parts, char **headers, int argc, char **argv) {
-    char c, **header = headers;
+    char **header = headers, *end;
+    int c;
 
     memset(cfg, 0, sizeof(struct config));
     cfg->threads     = 2;
@@ -965,6 +2615,10 @@ static int parse_args(struct config *cfg, char **url, struct http_parser_url *pa
     cfg->record_all_responses = true;
     cfg->warmup      = false;
     cfg->warmup_timeout = 0;
+    cfg->hdr_digits  = 3;
+    cfg->hdr_max     = MAX_LATENCY;
+    cfg->responder.size = 128;
+    cfg->catch_up_factor = 2;
 
     while ((c = getopt_long(argc, argv, "t:c:i:d:s:H:T:R:LUBrWv?", longopts, NULL)) != -1) {
         switch (c) {
@@ -1010,6 +2664,142 @@ static int parse_args(struct config *cfg, char **url, struct http_parser_url *pa
             case 'W':
                 cfg->warmup = true;
                 break;
+            case OPT_RESPONSE_SAMPLE:
+                cfg->response_sample = strtod(optarg, &end);
+                if (*end || cfg->response_sample <= 0 || cfg->response_sample > 1) {
+                    fprintf(stderr, "response sample must be in (0, 1]\n");
+                    return -1;
+                }
+                break;
+            case OPT_RESPONSE_RATE:
+                if (scan_metric(optarg, &cfg->response_rate)) return -1;
+                break;
+            case OPT_RESPONSE_ERRORS:
+                cfg->response_errors = true;
+                break;
+            case OPT_PROCESSES:
+                if (scan_metric(optarg, &cfg->processes)) return -1;
+                break;
+            case OPT_WORKERS:
+                cfg->workers = optarg;
+                break;
+            case OPT_SERVE:
+                cfg->serve = optarg;
+                break;
+            case OPT_HDR_LOG:
+                cfg->hdr_log = optarg;
+                break;
+            case OPT_HDR_DIGITS:
+                if (scan_metric(optarg, &cfg->hdr_digits)) return -1;
+                if (cfg->hdr_digits < 1 || cfg->hdr_digits > 5) {
+                    fprintf(stderr, "histogram significant figures must be in [1, 5]\n");
+                    return -1;
+                }
+                break;
+            case OPT_HDR_MAX:
+                // Histograms need a range of at least twice their 1us floor.
+                if (scan_time_us(optarg, &cfg->hdr_max) || cfg->hdr_max < 2) return -1;
+                break;
+            case OPT_HDR_AUTO:
+                cfg->hdr_auto = true;
+                break;
+            case OPT_HDR_INTERVAL:
+                if (scan_time(optarg, &cfg->hdr_interval) || !cfg->hdr_interval) return -1;
+                break;
+            case OPT_STEADY:
+                cfg->steady = strtod(optarg, &end);
+                if (*end || cfg->steady <= 0 || cfg->steady >= 1) {
+                    fprintf(stderr, "steady state tolerance must be in (0, 1)\n");
+                    return -1;
+                }
+                break;
+            case OPT_CATCH_UP:
+                if (scan_catch_up(optarg)) return -1;
+                break;
+            case OPT_DRAIN:
+                if (scan_time_us(optarg, &cfg->drain)) return -1;
+                break;
+            case OPT_SPIN:
+                if (!strcmp(optarg, "always")) {
+                    cfg->spin = AE_SPIN_ALWAYS;
+                } else {
+                    uint64_t spin;
+                    if (scan_time_us(optarg, &spin)) return -1;
+                    cfg->spin = spin;
+                }
+                break;
+            case OPT_BUSY_POLL:
+#ifdef SO_BUSY_POLL
+                if (scan_time_us(optarg, &cfg->busy_poll) || cfg->busy_poll > INT_MAX) return -1;
+#else
+                fprintf(stderr, "--busy_poll is not supported on this platform\n");
+                return -1;
+#endif
+                break;
+            case OPT_TCP_INFO:
+#ifdef __linux__
+                if (scan_metric(optarg, &cfg->tcp_info) || !cfg->tcp_info) return -1;
+#else
+                fprintf(stderr, "--tcp_info is not supported on this platform\n");
+                return -1;
+#endif
+                break;
+            case OPT_LUA_GC:
+                if (scan_time_us(optarg, &cfg->lua_gc) || !cfg->lua_gc) return -1;
+                break;
+            case OPT_HUGE_PAGES:
+                if (!strcmp(optarg, "transparent")) {
+                    cfg->huge_pages = HUGE_PAGES_TRANSPARENT;
+                } else if (!strcmp(optarg, "explicit")) {
+                    cfg->huge_pages = HUGE_PAGES_EXPLICIT;
+                } else {
+                    return -1;
+                }
+                break;
+            case OPT_TIMESTAMPS:
+#ifdef SO_TIMESTAMPING
+                if (!strcmp(optarg, "software")) {
+                    cfg->timestamps = TIMESTAMPS_SOFTWARE;
+                } else if (!strcmp(optarg, "hardware")) {
+                    cfg->timestamps = TIMESTAMPS_HARDWARE;
+                } else {
+                    return -1;
+                }
+#else
+                fprintf(stderr, "--timestamps is not supported on this platform\n");
+                return -1;
+#endif
+                break;
+            case OPT_WARMUP_DURATION:
+                if (scan_time(optarg, &cfg->warmup_duration)) return -1;
+                break;
+            case OPT_WARMUP_REQUESTS:
+                if (scan_metric(optarg, &cfg->warmup_requests)) return -1;
+                break;
+            case OPT_WARMUP_RATE:
+                if (scan_rate_range(optarg, cfg->warmup_rate)) return -1;
+                break;
+            case OPT_CONTROL:
+                cfg->control_socket = optarg;
+                break;
+            case OPT_MAX_CONNECTIONS:
+                if (scan_metric(optarg, &cfg->max_connections)) return -1;
+                break;
+            case OPT_METRICS:
+                cfg->metrics = optarg;
+                break;
+            case OPT_SELF_TEST:
+                cfg->self_test = true;
+                break;
+            case OPT_RESPONDER_SIZE:
+                if (scan_metric(optarg, &cfg->responder.size)) return -1;
+                break;
+            case OPT_RESPONDER_DELAY:
+                if (scan_time_us(optarg, &cfg->responder.delay)) return -1;
+                break;
+            case OPT_RESPONDER_DIST:
+                if (responder_parse_dist(optarg, &cfg->responder.dist)) return -1;
+                break;
             case 'h':
             case '?':
             case ':':
@@ -1018,9 +2808,12 @@ static int parse_args(struct config *cfg, char **url, struct http_parser_url *pa
         }
     }
 
-    if (optind == argc || !cfg->threads || !cfg->duration) return -1;
+    // Workers get their options from the coordinator.
+    if (cfg->serve) return 0;
 
-    if (!script_parse_url(argv[optind], parts)) {
+    if ((optind == argc && !cfg->self_test) || !cfg->threads || !cfg->duration) return -1;
+
+    if (optind < argc && !script_parse_url(argv[optind], parts)) {
         fprintf(stderr, "invalid URL: %s\n", argv[optind]);
         return -1;
     }
@@ -1036,7 +2829,60 @@ static int parse_args(struct config *cfg, char **url, struct http_parser_url *pa
         return -1;
     }
 
-    *url    = argv[optind];
+    if (cfg->warmup_rate[1] && !cfg->warmup_duration && !cfg->warmup_requests) {
+        fprintf(stderr, "--warmup_rate requires --warmup_duration or --warmup_requests\n");
+        return -1;
+    }
+
+    if (cfg->warmup_rate[1] && !cfg->warmup_rate[0]) {
+        fprintf(stderr, "--warmup_rate must be > 0\n");
+        return -1;
+    }
+
+    if (!cfg->warmup_rate[1]) {
+        cfg->warmup_rate[0] = cfg->rate;
+        cfg->warmup_rate[1] = cfg->rate;
+    }
+
+    if (cfg->hdr_interval && !cfg->hdr_log) {
+        fprintf(stderr, "--hdr_interval requires --hdr_log\n");
+        return -1;
+    }
+
+    uint64_t workers = cfg->processes + csv_nr(cfg->workers);
+    if (workers > 0 && (cfg->connections < workers || cfg->rate < workers)) {
+        fprintf(stderr, "connections and rate must be >= number of workers\n");
+        return -1;
+    }
+
+    if (workers > 0 && cfg->self_test) {
+        fprintf(stderr, "--self_test runs in a single process\n");
+        return -1;
+    }
+
+    if (workers > 0 && cfg->control_socket) {
+        fprintf(stderr, "--control runs in a single process\n");
+        return -1;
+    }
+
+    if (workers > 0 && cfg->metrics) {
+        fprintf(stderr, "--metrics runs in a single process\n");
+        return -1;
+    }
+
+    // Interval histograms feed both the log and the metrics.
+    cfg->interval = cfg->hdr_interval;
+    if (!cfg->interval && cfg->metrics) cfg->interval = METRICS_INTERVAL_S;
+
+    if (cfg->max_connections < cfg->connections) {
+        if (cfg->max_connections) {
+            fprintf(stderr, "--max_connections must be >= connections\n");
+            return -1;
+        }
+        cfg->max_connections = cfg->connections;
+    }
+
+    *url    = optind < argc ? argv[optind] : NULL;
     *header = NULL;
 
     return 0;
@@ -1084,3 +2930,109 @@ static void print_hdr_latency(struct hdr_histogram* histogram, const char* descr
     printf("\n%s\n", "  Detailed Percentile spectrum:");
     hdr_percentiles_print(histogram, stdout, 5, 1000.0, CLASSIC);
 }
+
+static stats *histogram_stats(struct hdr_histogram *histogram) {
+    stats *s = stats_alloc(10);
+    s->min = hdr_min(histogram);
+    s->max = hdr_max(histogram);
+    s->histogram = histogram;
+    return s;
+}
+
+static void print_statuses(statuses *statuses) {
+    const char *sep = "";
+
+    printf("  Status classes:");
+    for (int class = 1; class <= 5; class++) {
+        uint64_t n = stats_status_class(statuses, class);
+        if (n) {
+            printf("%s %dxx %"PRIu64, sep, class, n);
+            sep = ",";
+        }
+    }
+    if (statuses->other) printf("%s other %"PRIu64, sep, statuses->other);
+    printf("\n");
+
+    sep = "";
+    printf("  Status codes:");
+    for (int i = 0; i <= STATUS_MAX - STATUS_MIN; i++) {
+        if (statuses->codes[i]) {
+            printf("%s %d %"PRIu64, sep, STATUS_MIN + i, statuses->codes[i]);
+            sep = ",";
+        }
+    }
+    printf("\n");
+}
+
+// Compare the latency seen on the wire, from the kernel timestamp of the
+// last byte of a request to that of the response, with the uncorrected
+// latency measured in userspace. The difference is spent in the client.
+static void print_wire_latency(results *results) {
+    struct hdr_histogram *wire = results->wire_histogram;
+
+    if (!wire->total_count) {
+        printf("  Wire latency: no kernel timestamps received\n");
+        return;
+    }
+
+    print_latency_table("layer", (char *[]) { "Wire", "Userspace" },
+            (struct hdr_histogram *[]) { wire, results->u_latency_histogram }, 2);
+    if (wire->total_count < results->complete) {
+        printf("  Wire latency of %"PRId64" of %"PRIu64" responses\n",
+               wire->total_count, results->complete);
+    }
+}
+
+// Print the 50/90/99/100 percentiles of a histogram as a table row.
+static void print_percentile_row(char *name, struct hdr_histogram *h, char *(*fmt)(long double)) {
+    long double percentiles[] = { 50.0, 90.0, 99.0, 100.0 };
+
+    printf("    %-16s", name);
+    for (size_t i = 0; i < ARRAY_SIZE(percentiles); i++) {
+        print_units(hdr_value_at_percentile(h, percentiles[i]), fmt, 10);
+    }
+    printf("\n");
+}
+
+// Show how long the Lua collector paused the event loop, and how often
+// it was left to run on its own because the loop stayed busy.
+static void print_gc_stats(gc_stats *gc) {
+    char *time = format_time_us(gc->time);
+
+    printf("  %-18s%9s %9s %9s %9s\n", "Lua GC", "50%", "90%", "99%", "Max");
+    print_percentile_row("Pause", gc->pauses, format_time_us);
+    printf("    %"PRIu64" steps, %"PRIu64" cycles, %"PRIu64" left automatic while busy, %s paused\n",
+           gc->steps, gc->cycles, gc->automatic, time);
+    free(time);
+}
+
+// Show the path as the kernel saw it, to tell network trouble from slow
+// responses when the latency tail grows.
+static void print_tcp_info(tcp_stats *tcp) {
+    if (!tcp->samples) {
+        printf("  TCP info: no samples\n");
+        return;
+    }
+
+    printf("  %-18s%9s %9s %9s %9s\n", "TCP info", "50%", "90%", "99%", "Max");
+    print_percentile_row("RTT", tcp->rtt, format_time_us);
+    print_percentile_row("RTT variance", tcp->rttvar, format_time_us);
+    print_percentile_row("Cwnd (segs)", tcp->cwnd, format_metric);
+    print_percentile_row("Unacked (segs)", tcp->unacked, format_metric);
+    printf("    %"PRIu64" samples, %"PRIu64" retransmitted segments\n",
+           tcp->samples, tcp->retransmits);
+}
+
+static void print_latency_table(char *title, char **names, struct hdr_histogram **histograms, int n) {
+    long double percentiles[] = { 50.0, 90.0, 99.0, 100.0 };
+
+    printf("  Latency by %-7s%9s %9s %9s %9s\n", title, "50%", "90%", "99%", "Max");
+    for (int i = 0; i < n; i++) {
+        printf("    %-16s", names[i]);
+        for (size_t j = 0; j < ARRAY_SIZE(percentiles); j++) {
+            int64_t v = hdr_value_at_percentile(histograms[i], percentiles[j]);
+            print_units(v, format_time_us, 10);
+        }
+        printf("\n");
+    }
+}
@@ -16,38 +16,167 @@
 #include "ae.h"
 #include "http_parser.h"
 #include "hdr_histogram.h"
+#include "hdr_recorder.h"
+#include "command.h"
+#include "arena.h"
+#include "template.h"
 
 #define VERSION  "4.0.0"
 #define RECVBUF  8192
+#define BUFFER_MIN     1024
+#define BUFFER_CLASSES 16
+#define BUFFER_CACHED  64
 #define SAMPLES  100000000
 
 #define SOCKET_TIMEOUT_MS   2000
 #define CALIBRATE_DELAY_MS  10000
 #define TIMEOUT_INTERVAL_MS 2000
 #define STOP_CHECK_INTERNAL_MS 2000
+#define DRAIN_CHECK_INTERVAL_MS 10
 #define THREAD_SYNC_INTERVAL_MS 1000
+#define COORDINATED_SYNC_INTERVAL_MS 10
+#define STEADY_INTERVAL_MS  1000
+#define STEADY_WINDOWS      3
+#define STEADY_SLACK_US     1000
+#define WARMUP_TICK_MS      100
+#define METRICS_INTERVAL_S  10
+#define METRICS_QUANTILES   5
+#define TCP_INFO_INTERVAL_MS 100
+#define TCP_INFO_MAX_SEGMENTS 1000000
+#define LUA_GC_MIN_KB        1024
+
+#define MAX_TAGS 64
+
+typedef struct {
+    char *name;
+    struct hdr_histogram *latency_histogram;
+    struct hdr_histogram *u_latency_histogram;
+} tag;
+
+// Path statistics sampled from TCP_INFO with --tcp_info. Times are in
+// microseconds, windows in segments.
+typedef struct {
+    uint64_t samples;
+    uint64_t retransmits;
+    struct hdr_histogram *rtt;
+    struct hdr_histogram *rttvar;
+    struct hdr_histogram *cwnd;
+    struct hdr_histogram *unacked;
+} tcp_stats;
+
+// Lua garbage collection paced by --lua_gc. Cycles counts the cycles
+// completed in idle time, automatic the times the collector was left to
+// run on its own because the heap doubled while the loop was busy.
+// Pauses are in microseconds.
+typedef struct {
+    uint64_t steps;
+    uint64_t cycles;
+    uint64_t automatic;
+    uint64_t time;
+    struct hdr_histogram *pauses;
+} gc_stats;
+
+typedef struct {
+    uint64_t runtime_us;
+    uint64_t complete;
+    uint64_t bytes;
+    errors errors;
+    statuses statuses;
+    struct hdr_histogram *latency_histogram;
+    struct hdr_histogram *u_latency_histogram;
+    struct hdr_histogram *success_histogram;
+    struct hdr_histogram *error_histogram;
+    struct hdr_histogram *requests_histogram;
+    uint64_t warmup_runtime_us;
+    uint64_t warmup_complete;
+    struct hdr_histogram *warmup_histogram;
+    uint64_t catch_up;
+    uint64_t dropped;
+    struct hdr_histogram *wire_histogram;
+    tcp_stats tcp;
+    gc_stats gc;
+    tag tags[MAX_TAGS];
+    int ntags;
+} results;
+
+typedef struct {
+    struct hdr_histogram *histogram;
+    uint64_t start;
+    uint64_t last;
+    uint64_t complete;
+    double rate[STEADY_WINDOWS];
+    double latency[STEADY_WINDOWS];
+    int windows;
+} steady_state;
+
+// Free response buffers of a thread by size class, powers of two from
+// BUFFER_MIN, keeping up to BUFFER_CACHED of each. Connections check
+// buffers out when a response starts and return them once it is done.
+typedef struct buffer_pool {
+    char *free[BUFFER_CLASSES];
+    uint32_t cached[BUFFER_CLASSES];
+} buffer_pool;
 
 typedef struct {
     pthread_t thread;
     aeEventLoop *loop;
     struct addrinfo *addr;
     uint64_t connections;
+    uint64_t max_connections;
     uint64_t phase_normal_start;
     int phase;
+    bool ready;
     int interval;
     uint64_t stop_at;
+    long long stop_timer;
+    uint64_t drain_until;
+    bool draining;
     uint64_t complete;
     uint64_t requests;
     uint64_t bytes;
+    uint64_t catch_up;
+    uint64_t dropped;
+    uint64_t lag;
     uint64_t start;
     double throughput;
+    double rate;
     uint64_t mean;
     struct hdr_histogram *latency_histogram;
     struct hdr_histogram *u_latency_histogram;
+    struct hdr_histogram *success_histogram;
+    struct hdr_histogram *error_histogram;
+    struct hdr_histogram *wire_histogram;
+    tcp_stats tcp;
+    uint64_t tcp_next;
+    gc_stats gc;
+    uint64_t gc_live;
+    bool gc_running;
+    bool gc_automatic;
+    bool same_layout;
+    struct hdr_recorder recorder;
+    steady_state steady;
+    uint64_t warmup_start;
+    uint64_t warmup_requests;
+    uint64_t warmup_runtime;
+    uint64_t warmup_complete;
+    struct hdr_histogram *warmup_histogram;
+    command_queue commands;
+    struct hdr_histogram *snapshot;
+    uint64_t snapshot_complete;
+    uint64_t snapshot_seq;
+    bool finished;
     tinymt64_t rand;
     lua_State *L;
+    template *template;
+    uint64_t sample_start;
+    uint64_t sampled;
     errors errors;
+    statuses statuses;
+    tag tags[MAX_TAGS];
+    int ntags;
     struct connection *cs;
+    arena arena;
+    buffer_pool buffers;
     char *local_ip;
 } thread;
 
@@ -55,6 +184,7 @@ typedef struct {
     char  *buffer;
     size_t length;
     char  *cursor;
+    struct buffer_pool *pool;
 } buffer;
 
 typedef struct connection {
@@ -63,6 +193,9 @@ typedef struct connection {
     enum {
         FIELD, VALUE
     } state;
+    enum {
+        SAMPLE_UNKNOWN, SAMPLE_YES, SAMPLE_NO
+    } sample;
     int fd;
     int connect_mask;
     SSL *ssl;
@@ -76,6 +209,7 @@ typedef struct connection {
     uint64_t start;
     char *request;
     size_t length;
+    int tag;
     size_t written;
     uint64_t pending;
     buffer headers;
@@ -85,6 +219,14 @@ typedef struct connection {
     bool is_connected;
     bool has_pending;
     bool caught_up;
+    bool behind;
+    // Kernel timestamps, in nanoseconds, with --timestamps:
+    uint64_t tx_bytes;
+    uint64_t tx_id;
+    uint64_t tx_timestamp;
+    uint64_t rx_timestamp;
+    bool tx_stamped;
+    uint32_t tcp_retransmits;
     // Internal tracking numbers (used purely for debugging):
     uint64_t latest_should_send_time;
     uint64_t latest_expected_start;
@@ -7,6 +7,7 @@ local wrk = {
    headers = {},
    body    = nil,
    thread  = nil,
+   lazy_response = false,
 }
 
 function wrk.resolve(host, service)
@@ -26,15 +27,19 @@ function wrk.setup(thread)
    end
 end
 
-function wrk.init(args)
-   if not wrk.headers["Host"] then
-      local host = wrk.host
-      local port = wrk.port
+local function host_header()
+   local host = wrk.host
+   local port = wrk.port
 
-      host = host:find(":") and ("[" .. host .. "]")  or host
-      host = port           and (host .. ":" .. port) or host
+   host = host:find(":") and ("[" .. host .. "]")  or host
+   host = port           and (host .. ":" .. port) or host
+
+   return host
+end
 
-      wrk.headers["Host"] = host
+function wrk.init(args)
+   if not wrk.headers["Host"] then
+      wrk.headers["Host"] = host_header()
    end
 
    if type(init) == "function" then
@@ -55,7 +60,7 @@ function wrk.format(method, path, headers, body)
    local s       = {}
 
    if not headers["Host"] then
-      headers["Host"] = wrk.headers["Host"]
+      headers["Host"] = wrk.headers["Host"] or host_header()
    end
 
    headers["Content-Length"] = body and string.len(body)
@@ -71,4 +76,8 @@ function wrk.format(method, path, headers, body)
    return table.concat(s, "\r\n")
 end
 
+function wrk.template(method, path, headers, body)
+   return wrk.compile(wrk.format(method, path, headers, body))
+end
+
 return wrk
@@ -0,0 +1,240 @@
+// Merge, print and compare HdrHistogram logs written by wrk --hdr_log.
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hdr_histogram.h"
+#include "hdr_histogram_log.h"
+
+#define MAX_TAGS    256
+#define MAX_TAG_LEN 256
+
+typedef struct {
+    char name[MAX_TAG_LEN];
+    struct hdr_histogram *histogram;
+} entry;
+
+typedef struct {
+    entry entries[MAX_TAGS];
+    int count;
+} entries;
+
+static double percentiles[] = { 50.0, 75.0, 90.0, 99.0, 99.9, 99.99, 99.999, 100.0 };
+
+static void usage() {
+    printf("Usage: wrk-hist <command> [options] <file>...             \n"
+           "  Commands:                                               \n"
+           "    print [-t <tag>] <file>...   Merge and print latency  \n"
+           "                                 percentiles              \n"
+           "    merge -o <out> <file>...     Merge every tag into a   \n"
+           "                                 single log file          \n"
+           "    diff  [-t <tag>] <a> <b>     Compare percentiles of   \n"
+           "                                 two runs                 \n"
+           "                                                          \n"
+           "  Options:                                                \n"
+           "    -t, --tag    <S>  Histogram tag, default latency      \n"
+           "    -o, --output <F>  Output file for merge               \n"
+           "                                                          \n"
+           "  Histograms with the same tag are added together, so    \n"
+           "  percentiles from many runs or hosts are combined exactly.\n");
+}
+
+static entry *entries_lookup(entries *e, const char *name) {
+    for (int i = 0; i < e->count; i++) {
+        if (!strcmp(e->entries[i].name, name)) return &e->entries[i];
+    }
+    return NULL;
+}
+
+// Add every histogram in path to e, merging those with the same tag.
+static int load(entries *e, char *path) {
+    FILE *file = fopen(path, "r");
+    char name[MAX_TAG_LEN];
+    struct hdr_histogram *h;
+    int rc;
+
+    if (!file) {
+        fprintf(stderr, "unable to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    while ((rc = hdr_log_read(file, name, sizeof(name), &h)) == 0) {
+        entry *entry = entries_lookup(e, name);
+        if (entry) {
+            hdr_add_grow(&entry->histogram, h);
+            free(h);
+            continue;
+        }
+
+        if (e->count == MAX_TAGS) {
+            fprintf(stderr, "%s: too many tags\n", path);
+            rc = EINVAL;
+            break;
+        }
+
+        entry = &e->entries[e->count++];
+        strcpy(entry->name, name);
+        entry->histogram = h;
+    }
+    fclose(file);
+
+    if (rc != EOF) {
+        fprintf(stderr, "%s: invalid histogram log: %s\n", path, strerror(rc));
+        return -1;
+    }
+    return 0;
+}
+
+static struct hdr_histogram *find(entries *e, char *path, char *tag) {
+    entry *entry = entries_lookup(e, tag);
+    if (!entry) {
+        fprintf(stderr, "%s: no histogram tagged '%s'\n", path, tag);
+        exit(1);
+    }
+    return entry->histogram;
+}
+
+static int print(char *tag, int argc, char **argv) {
+    entries e = { .count = 0 };
+
+    for (int i = 0; i < argc; i++) {
+        if (load(&e, argv[i])) return 1;
+    }
+
+    struct hdr_histogram *h = find(&e, argc == 1 ? argv[0] : "input", tag);
+
+    printf("  Latency Distribution (HdrHistogram - %s, %d file(s))\n", tag, argc);
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(double); i++) {
+        printf("%7.3f%% %9.3fms\n", percentiles[i],
+               hdr_value_at_percentile(h, percentiles[i]) / 1000.0);
+    }
+    printf("\n%s\n", "  Detailed Percentile spectrum:");
+    hdr_percentiles_print(h, stdout, 5, 1000.0, CLASSIC);
+
+    return 0;
+}
+
+static int merge(char *output, int argc, char **argv) {
+    entries e = { .count = 0 };
+    int rc = 0;
+
+    if (!output) {
+        fprintf(stderr, "merge requires an output file (-o)\n");
+        return 1;
+    }
+
+    for (int i = 0; i < argc; i++) {
+        if (load(&e, argv[i])) return 1;
+    }
+
+    FILE *file = fopen(output, "w");
+    if (!file) {
+        fprintf(stderr, "unable to open %s: %s\n", output, strerror(errno));
+        return 1;
+    }
+
+    rc |= hdr_log_write_header(file, "wrk-hist", 0);
+    for (int i = 0; i < e.count; i++) {
+        char *name = e.entries[i].name;
+        rc |= hdr_log_write(file, *name ? name : NULL, 0, 0, e.entries[i].histogram);
+    }
+
+    if (fclose(file) || rc) {
+        fprintf(stderr, "unable to write %s\n", output);
+        return 1;
+    }
+    return 0;
+}
+
+static void diff_row(char *name, double a, double b) {
+    printf("  %-10s %12.3f %12.3f", name, a, b);
+    if (a > 0) {
+        printf(" %+9.2f%%\n", (b - a) * 100.0 / a);
+    } else {
+        printf(" %10s\n", "-");
+    }
+}
+
+static int diff(char *tag, int argc, char **argv) {
+    entries a = { .count = 0 }, b = { .count = 0 };
+
+    if (argc != 2) {
+        usage();
+        return 1;
+    }
+
+    if (load(&a, argv[0]) || load(&b, argv[1])) return 1;
+
+    struct hdr_histogram *ha = find(&a, argv[0], tag);
+    struct hdr_histogram *hb = find(&b, argv[1], tag);
+
+    printf("  %-10s %12s %12s %10s\n", tag, "A (ms)", "B (ms)", "Change");
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(double); i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "%.3f%%", percentiles[i]);
+        diff_row(name, hdr_value_at_percentile(ha, percentiles[i]) / 1000.0,
+                       hdr_value_at_percentile(hb, percentiles[i]) / 1000.0);
+    }
+    diff_row("Mean", hdr_mean(ha) / 1000.0, hdr_mean(hb) / 1000.0);
+    diff_row("Stdev", hdr_stddev(ha) / 1000.0, hdr_stddev(hb) / 1000.0);
+    printf("  %-10s %12"PRId64" %12"PRId64"\n", "Count", ha->total_count, hb->total_count);
+
+    return 0;
+}
+
+static struct option longopts[] = {
+    { "tag",    required_argument, NULL, 't' },
+    { "output", required_argument, NULL, 'o' },
+    { "help",   no_argument,       NULL, 'h' },
+    { NULL,     0,                 NULL,  0  }
+};
+
+int main(int argc, char **argv) {
+    char *tag = "latency", *output = NULL;
+    int c;
+
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+
+    char *command = argv[1];
+    argc--;
+    argv++;
+
+    while ((c = getopt_long(argc, argv, "t:o:h?", longopts, NULL)) != -1) {
+        switch (c) {
+            case 't':
+                tag = optarg;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'h':
+            case '?':
+            default:
+                usage();
+                return 1;
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc == 0) {
+        usage();
+        return 1;
+    }
+
+    if (!strcmp(command, "print")) return print(tag, argc, argv);
+    if (!strcmp(command, "merge")) return merge(output, argc, argv);
+    if (!strcmp(command, "diff"))  return diff(tag, argc, argv);
+
+    usage();
+    return 1;
+}
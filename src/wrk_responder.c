@@ -0,0 +1,93 @@
+// Standalone loopback HTTP responder, to measure wrk against a server
+// whose latency is known and which can run on its own cores.
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "responder.h"
+#include "units.h"
+
+static void usage() {
+    printf("Usage: wrk-responder <options>                        \n"
+           "  Options:                                            \n"
+           "    -a, --addr    <S>  Address to listen on           \n"
+           "                       (default 127.0.0.1)            \n"
+           "    -p, --port    <N>  Port to listen on (default 8080)\n"
+           "    -t, --threads <N>  Number of threads to use       \n"
+           "    -s, --size    <N>  Response body size (default 128)\n"
+           "    -d, --delay   <T>  Mean delay before responding   \n"
+           "    -D, --dist    <S>  Delay distribution: fixed,     \n"
+           "                       uniform or exponential         \n"
+           "                                                      \n"
+           "  Numeric arguments may include a SI unit (1k, 1M, 1G)\n"
+           "  Delays may include a time unit (500us, 2ms, 1s) and \n"
+           "  are rounded to milliseconds.                        \n");
+}
+
+static struct option longopts[] = {
+    { "addr",    required_argument, NULL, 'a' },
+    { "port",    required_argument, NULL, 'p' },
+    { "threads", required_argument, NULL, 't' },
+    { "size",    required_argument, NULL, 's' },
+    { "delay",   required_argument, NULL, 'd' },
+    { "dist",    required_argument, NULL, 'D' },
+    { "help",    no_argument,       NULL, 'h' },
+    { NULL,      0,                 NULL,  0  }
+};
+
+int main(int argc, char **argv) {
+    responder_config cfg = {
+        .threads = 1,
+        .size    = 128,
+        .delay   = 0,
+        .dist    = DELAY_FIXED,
+    };
+    char *addr = "127.0.0.1", *port = "8080";
+    int c;
+
+    while ((c = getopt_long(argc, argv, "a:p:t:s:d:D:h?", longopts, NULL)) != -1) {
+        switch (c) {
+            case 'a':
+                addr = optarg;
+                break;
+            case 'p':
+                port = optarg;
+                break;
+            case 't':
+                if (scan_metric(optarg, &cfg.threads) || !cfg.threads) goto usage;
+                break;
+            case 's':
+                if (scan_metric(optarg, &cfg.size)) goto usage;
+                break;
+            case 'd':
+                if (scan_time_us(optarg, &cfg.delay)) goto usage;
+                break;
+            case 'D':
+                if (responder_parse_dist(optarg, &cfg.dist)) goto usage;
+                break;
+            case 'h':
+            case '?':
+            default:
+                goto usage;
+        }
+    }
+
+    int bound = responder_start(&cfg, addr, port);
+    if (bound < 0) {
+        fprintf(stderr, "unable to listen on %s:%s\n", addr, port);
+        return 1;
+    }
+
+    printf("Responding on %s:%d with %"PRIu64" threads, %sB responses\n",
+           addr, bound, cfg.threads, format_binary(cfg.size));
+    fflush(stdout);
+
+    for (;;) pause();
+
+  usage:
+    usage();
+    return 1;
+}
@@ -83,6 +83,7 @@
 } while(0)
 
 static size_t used_memory = 0;
+static size_t mapped_memory = 0;
 static int zmalloc_thread_safe = 0;
 pthread_mutex_t used_memory_mutex = PTHREAD_MUTEX_INITIALIZER;
 
@@ -196,7 +197,22 @@ size_t zmalloc_used_memory(void) {
     if (zmalloc_thread_safe) pthread_mutex_lock(&used_memory_mutex);
     um = used_memory;
     if (zmalloc_thread_safe) pthread_mutex_unlock(&used_memory_mutex);
-    return um;
+    return um + zmalloc_mapped_memory();
+}
+
+/* Memory mapped directly by arenas rather than through malloc(), which is
+ * counted in zmalloc_used_memory() too. Arenas map and unmap from several
+ * threads, so the counter is always updated atomically. */
+size_t zmalloc_mapped_memory(void) {
+    return __atomic_load_n(&mapped_memory, __ATOMIC_RELAXED);
+}
+
+void zmalloc_stat_mapped(size_t size) {
+    __atomic_add_fetch(&mapped_memory, size, __ATOMIC_RELAXED);
+}
+
+void zmalloc_stat_unmapped(size_t size) {
+    __atomic_sub_fetch(&mapped_memory, size, __ATOMIC_RELAXED);
 }
 
 void zmalloc_enable_thread_safeness(void) {
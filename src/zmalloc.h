@@ -72,6 +72,9 @@ void *zrealloc(void *ptr, size_t size);
 void zfree(void *ptr);
 char *zstrdup(const char *s);
 size_t zmalloc_used_memory(void);
+size_t zmalloc_mapped_memory(void);
+void zmalloc_stat_mapped(size_t size);
+void zmalloc_stat_unmapped(size_t size);
 void zmalloc_enable_thread_safeness(void);
 float zmalloc_get_fragmentation_ratio(void);
 size_t zmalloc_get_rss(void);